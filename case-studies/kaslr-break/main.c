@@ -54,13 +54,22 @@ inline __attribute__((always_inline)) void prefetch(size_t p) {
 
 static float results[TRIES];
 
+#if WITH_TLB_EVICT == 1
+/* Targeted eviction is opt-in, it is not known to clear the L1 dTLB */
+static bool evict_targeted = false;
+#endif
+
 size_t measure(size_t offset, size_t* min_p, size_t* max_p) {
   uint64_t begin = 0, end = 0;
 
   for (size_t i = 0; i < TRIES; i++) {
     /* Clear TLB */
 #if WITH_TLB_EVICT == 1
-    tlb_flush();
+    if (evict_targeted == true) {
+      tlb_evict_address(offset);
+    } else {
+      tlb_flush();
+    }
 #endif
 
     /* Begin measurement */
@@ -97,6 +106,9 @@ static void
 print_help(char* argv[]) {
   fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
   fprintf(stdout, "\t-c, -core <value>\t Bind to cpu (default: " STR(CORE1) ")\n");
+#if WITH_TLB_EVICT == 1
+  fprintf(stdout, "\t-e, -evict-targeted\t Evict only the probed page instead of the whole TLB\n");
+#endif
   fprintf(stdout, "\t-h, -help\t\t Help page\n");
 }
 
@@ -109,9 +121,16 @@ int main(int argc, char* argv[]) {
   /* Parse arguments */
   size_t cpu = CORE1;
 
+#if WITH_TLB_EVICT == 1
+  static const char* short_options = "c:eh";
+#else
   static const char* short_options = "c:h";
+#endif
   static struct option long_options[] = {
     {"cpu",             required_argument, NULL, 'c'},
+#if WITH_TLB_EVICT == 1
+    {"evict-targeted",  no_argument,       NULL, 'e'},
+#endif
     {"help",            no_argument,       NULL, 'h'},
     { NULL,             0, NULL, 0}
   };
@@ -128,6 +147,11 @@ int main(int argc, char* argv[]) {
           return -1;
         }
         break;
+#if WITH_TLB_EVICT == 1
+      case 'e':
+        evict_targeted = true;
+        break;
+#endif
       case 'h':
         print_help(argv);
         return 0;
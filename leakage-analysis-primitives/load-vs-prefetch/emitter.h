@@ -0,0 +1,114 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Minimal x86-64 machine-code emitter for measurement kernels.
+ *
+ * Every instruction is a fixed byte template. Memory operands always use a
+ * 32-bit displacement, so all instances of a template have the same length
+ * and the displacement can be patched in place without moving any code. */
+
+#define EMITTER_MAX_LENGTH 15
+#define EMITTER_NO_DISPLACEMENT 0xff
+
+typedef struct emitter_template_s {
+  const char* name;
+  uint8_t length;
+  uint8_t displacement;         /* offset of the disp32 field */
+  uint8_t bytes[EMITTER_MAX_LENGTH];
+} emitter_template_t;
+
+#define EMITTER_TEMPLATE(n, d, ...) \
+  { .name = n, .length = sizeof((uint8_t[]) { __VA_ARGS__ }), .displacement = d, .bytes = { __VA_ARGS__ } }
+
+#define D EMITTER_NO_DISPLACEMENT
+
+/* Measurement frame: r8 holds the buffer, r9 the start timestamp */
+static const emitter_template_t EMIT_MOV_R8_RDX       = EMITTER_TEMPLATE("mov r8, rdx",            D, 0x49, 0x89, 0xd0);
+static const emitter_template_t EMIT_MOV_R9_RAX       = EMITTER_TEMPLATE("mov r9, rax",            D, 0x49, 0x89, 0xc1);
+static const emitter_template_t EMIT_MOV_RAX_0        = EMITTER_TEMPLATE("mov rax, 0",             D, 0x48, 0xc7, 0xc0, 0x00, 0x00, 0x00, 0x00);
+static const emitter_template_t EMIT_SHL_RDX_32       = EMITTER_TEMPLATE("shl rdx, 0x20",          D, 0x48, 0xc1, 0xe2, 0x20);
+static const emitter_template_t EMIT_OR_RAX_RDX       = EMITTER_TEMPLATE("or rax, rdx",            D, 0x48, 0x09, 0xd0);
+static const emitter_template_t EMIT_SUB_RAX_R9       = EMITTER_TEMPLATE("sub rax, r9",            D, 0x4c, 0x29, 0xc8);
+static const emitter_template_t EMIT_CLFLUSH_R8       = EMITTER_TEMPLATE("clflush [r8]",           D, 0x41, 0x0f, 0xae, 0x38);
+static const emitter_template_t EMIT_MOVNTDQA_R8      = EMITTER_TEMPLATE("movntdqa xmm10, [r8]",   D, 0x66, 0x45, 0x0f, 0x38, 0x2a, 0x10);
+static const emitter_template_t EMIT_RDTSC            = EMITTER_TEMPLATE("rdtsc",                  D, 0x0f, 0x31);
+static const emitter_template_t EMIT_RDTSCP           = EMITTER_TEMPLATE("rdtscp",                 D, 0x0f, 0x01, 0xf9);
+static const emitter_template_t EMIT_LFENCE           = EMITTER_TEMPLATE("lfence",                 D, 0x0f, 0xae, 0xe8);
+static const emitter_template_t EMIT_MFENCE           = EMITTER_TEMPLATE("mfence",                 D, 0x0f, 0xae, 0xf0);
+static const emitter_template_t EMIT_SFENCE           = EMITTER_TEMPLATE("sfence",                 D, 0x0f, 0xae, 0xf8);
+static const emitter_template_t EMIT_NOP              = EMITTER_TEMPLATE("nop",                    D, 0x90);
+static const emitter_template_t EMIT_RET              = EMITTER_TEMPLATE("ret",                    D, 0xc3);
+
+/* Memory accesses with a patchable displacement */
+static const emitter_template_t EMIT_STORE_R8         = EMITTER_TEMPLATE("mov [r8 + d], r15",      3, 0x4d, 0x89, 0xb8, 0, 0, 0, 0);
+static const emitter_template_t EMIT_LOAD_R8          = EMITTER_TEMPLATE("mov r15, [r8 + d]",      3, 0x4d, 0x8b, 0xb8, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHT0_R8    = EMITTER_TEMPLATE("prefetcht0 [r8 + d]",    4, 0x41, 0x0f, 0x18, 0x88, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHT1_R8    = EMITTER_TEMPLATE("prefetcht1 [r8 + d]",    4, 0x41, 0x0f, 0x18, 0x90, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHT2_R8    = EMITTER_TEMPLATE("prefetcht2 [r8 + d]",    4, 0x41, 0x0f, 0x18, 0x98, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHNTA_R8   = EMITTER_TEMPLATE("prefetchnta [r8 + d]",   4, 0x41, 0x0f, 0x18, 0x80, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHW_R8     = EMITTER_TEMPLATE("prefetchw [r8 + d]",     4, 0x41, 0x0f, 0x0d, 0x88, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHT0_RDI   = EMITTER_TEMPLATE("prefetcht0 [rdi + d]",   3, 0x0f, 0x18, 0x8f, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHT1_RDI   = EMITTER_TEMPLATE("prefetcht1 [rdi + d]",   3, 0x0f, 0x18, 0x97, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHT2_RDI   = EMITTER_TEMPLATE("prefetcht2 [rdi + d]",   3, 0x0f, 0x18, 0x9f, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHNTA_RDI  = EMITTER_TEMPLATE("prefetchnta [rdi + d]",  3, 0x0f, 0x18, 0x87, 0, 0, 0, 0);
+static const emitter_template_t EMIT_PREFETCHW_RDI    = EMITTER_TEMPLATE("prefetchw [rdi + d]",    3, 0x0f, 0x0d, 0x8f, 0, 0, 0, 0);
+
+#undef D
+
+typedef struct emitter_s {
+  uint8_t* code;
+  size_t size;
+  size_t position;
+  bool overflow;
+} emitter_t;
+
+void emitter_init(emitter_t* emitter, uint8_t* code, size_t size) {
+  emitter->code = code;
+  emitter->size = size;
+  emitter->position = 0;
+  emitter->overflow = false;
+}
+
+void emitter_seek(emitter_t* emitter, size_t position) {
+  emitter->position = position;
+}
+
+static inline void emitter_patch_displacement(uint8_t* instruction, const emitter_template_t* t, int32_t displacement) {
+  memcpy(instruction + t->displacement, &displacement, sizeof(displacement));
+}
+
+/* Appends one instruction and returns its offset */
+static inline size_t emit_displacement(emitter_t* emitter, const emitter_template_t* t, int32_t displacement) {
+  size_t position = emitter->position;
+  if (position + t->length > emitter->size) {
+    emitter->overflow = true;
+    return position;
+  }
+
+  memcpy(emitter->code + position, t->bytes, t->length);
+  if (t->displacement != EMITTER_NO_DISPLACEMENT) {
+    emitter_patch_displacement(emitter->code + position, t, displacement);
+  }
+  emitter->position += t->length;
+
+  return position;
+}
+
+static inline size_t emit(emitter_t* emitter, const emitter_template_t* t) {
+  return emit_displacement(emitter, t, 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
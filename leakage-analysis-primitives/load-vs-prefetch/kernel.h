@@ -0,0 +1,298 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "emitter.h"
+
+/* Measurement kernels generated from a one-line spec, e.g.
+ *
+ *   name=prefetch ops=prefetcht0 stride=4096 count=1..256 setup=uncached fence=none
+ *   name=mixed ops=load,nop,nop stride=64 count=8..512:8 setup=cached fence=lfence
+ *
+ *   name    label in the output (default: the ops joined by +)
+ *   ops     instruction mix, repeated in order: nop, load, store, prefetcht0,
+ *           prefetcht1, prefetcht2, prefetchnta, prefetchw, lfence, mfence, sfence
+ *   stride  displacement step in bytes between memory operands (0: same line)
+ *   count   number of instructions under test: n, first..last or first..last:step
+ *   setup   uncached (flush the lines before every run) or cached (access them)
+ *   fence   none, lfence, mfence or sfence after every instruction under test
+ *
+ * Memory operands are relative to the buffer passed in rdx (r8 in the kernel).
+ * Kernels use the measurement frame
+ *
+ *   mov r8, rdx; clflush [r8]; lfence
+ *   rdtsc; shl rdx, 0x20; or rax, rdx; mov r9, rax; mov rax, 0; movntdqa xmm10, [r8]
+ *   <instructions under test>
+ *   rdtsc; mfence; shl rdx, 0x20; or rax, rdx; sub rax, r9; ret
+ *
+ * and return the cycles between the two rdtsc. */
+
+#define KERNEL_MAX_MIX 8
+#define KERNEL_NAME_LENGTH 64
+
+/* Instructions between and including the two rdtsc, apart from the ones
+ * under test */
+#define FRAME_INSTRUCTIONS 7
+
+typedef size_t (*kernel_function_t)(size_t);
+
+typedef struct kernel_operation_s {
+  const char* name;
+  const emitter_template_t* instruction;
+} kernel_operation_t;
+
+static const kernel_operation_t kernel_operations[] = {
+  { "nop",         &EMIT_NOP },
+  { "load",        &EMIT_LOAD_R8 },
+  { "store",       &EMIT_STORE_R8 },
+  { "prefetcht0",  &EMIT_PREFETCHT0_R8 },
+  { "prefetcht1",  &EMIT_PREFETCHT1_R8 },
+  { "prefetcht2",  &EMIT_PREFETCHT2_R8 },
+  { "prefetchnta", &EMIT_PREFETCHNTA_R8 },
+  { "prefetchw",   &EMIT_PREFETCHW_R8 },
+  { "lfence",      &EMIT_LFENCE },
+  { "mfence",      &EMIT_MFENCE },
+  { "sfence",      &EMIT_SFENCE },
+};
+
+static const kernel_operation_t kernel_fences[] = {
+  { "none",   NULL },
+  { "lfence", &EMIT_LFENCE },
+  { "mfence", &EMIT_MFENCE },
+  { "sfence", &EMIT_SFENCE },
+};
+
+typedef struct kernel_spec_s {
+  char name[KERNEL_NAME_LENGTH];
+  const emitter_template_t* mix[KERNEL_MAX_MIX];
+  size_t mix_length;
+  const emitter_template_t* fence;
+  size_t stride;
+  size_t count_begin;
+  size_t count_end;
+  size_t count_step;
+  bool cached;
+} kernel_spec_t;
+
+typedef struct kernel_s {
+  emitter_t emitter;
+  const emitter_template_t* mix[KERNEL_MAX_MIX];
+  size_t mix_length;
+  const emitter_template_t* fence;
+  size_t stride;
+
+  size_t body;                          /* offset of the first instruction under test */
+  size_t prefix[KERNEL_MAX_MIX + 1];    /* offsets within one round of the mix */
+  size_t count;
+} kernel_t;
+
+static const emitter_template_t* _kernel_lookup(const kernel_operation_t* operations, size_t n, const char* name, bool* found) {
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(operations[i].name, name) == 0) {
+      *found = true;
+      return operations[i].instruction;
+    }
+  }
+
+  *found = false;
+  return NULL;
+}
+
+static bool _kernel_parse_count(kernel_spec_t* spec, const char* value) {
+  char* end;
+  spec->count_begin = strtoull(value, &end, 0);
+  spec->count_end = spec->count_begin;
+  spec->count_step = 1;
+
+  if (strncmp(end, "..", 2) == 0) {
+    spec->count_end = strtoull(end + 2, &end, 0);
+    if (*end == ':') {
+      spec->count_step = strtoull(end + 1, &end, 0);
+    }
+  }
+
+  return (*end == '\0' && spec->count_begin > 0 && spec->count_begin <= spec->count_end && spec->count_step > 0);
+}
+
+/* Parses one spec line; unset fields keep their defaults */
+bool kernel_spec_parse(kernel_spec_t* spec, const char* line) {
+  memset(spec, 0, sizeof(*spec));
+  spec->stride = 4096;
+  spec->count_begin = 1;
+  spec->count_end = 256;
+  spec->count_step = 1;
+
+  char ops[KERNEL_NAME_LENGTH] = "";
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer), "%s", line);
+
+  char* saveptr = NULL;
+  for (char* token = strtok_r(buffer, " \t\n", &saveptr); token != NULL; token = strtok_r(NULL, " \t\n", &saveptr)) {
+    char* value = strchr(token, '=');
+    if (value == NULL) {
+      fprintf(stderr, "Error: Expected key=value, got '%s'\n", token);
+      return false;
+    }
+    *value++ = '\0';
+
+    bool found = true;
+    if (strcmp(token, "name") == 0) {
+      snprintf(spec->name, sizeof(spec->name), "%s", value);
+    } else if (strcmp(token, "ops") == 0) {
+      char* saveptr_ops = NULL;
+      snprintf(ops, sizeof(ops), "%s", value);
+      spec->mix_length = 0;
+      for (char* op = strtok_r(value, ",", &saveptr_ops); op != NULL; op = strtok_r(NULL, ",", &saveptr_ops)) {
+        if (spec->mix_length == KERNEL_MAX_MIX) {
+          fprintf(stderr, "Error: At most %d operations per kernel\n", KERNEL_MAX_MIX);
+          return false;
+        }
+        spec->mix[spec->mix_length++] = _kernel_lookup(kernel_operations,
+            sizeof(kernel_operations) / sizeof(kernel_operations[0]), op, &found);
+        if (found == false) {
+          fprintf(stderr, "Error: Unknown operation '%s'\n", op);
+          return false;
+        }
+      }
+    } else if (strcmp(token, "stride") == 0) {
+      spec->stride = strtoull(value, NULL, 0);
+    } else if (strcmp(token, "count") == 0) {
+      if (_kernel_parse_count(spec, value) == false) {
+        fprintf(stderr, "Error: Invalid count '%s'\n", value);
+        return false;
+      }
+    } else if (strcmp(token, "setup") == 0) {
+      if (strcmp(value, "cached") == 0) {
+        spec->cached = true;
+      } else if (strcmp(value, "uncached") == 0) {
+        spec->cached = false;
+      } else {
+        fprintf(stderr, "Error: Unknown setup '%s'\n", value);
+        return false;
+      }
+    } else if (strcmp(token, "fence") == 0) {
+      spec->fence = _kernel_lookup(kernel_fences, sizeof(kernel_fences) / sizeof(kernel_fences[0]), value, &found);
+      if (found == false) {
+        fprintf(stderr, "Error: Unknown fence '%s'\n", value);
+        return false;
+      }
+    } else {
+      fprintf(stderr, "Error: Unknown key '%s'\n", token);
+      return false;
+    }
+  }
+
+  if (spec->mix_length == 0) {
+    fprintf(stderr, "Error: Kernel without ops\n");
+    return false;
+  }
+
+  /* Default name: the ops, joined by + to keep it a single CSV field */
+  if (spec->name[0] == '\0') {
+    snprintf(spec->name, sizeof(spec->name), "%s", ops);
+    for (char* p = strchr(spec->name, ','); p != NULL; p = strchr(p, ',')) {
+      *p = '+';
+    }
+  }
+
+  if (spec->stride * (spec->count_end - 1) > INT32_MAX) {
+    fprintf(stderr, "Error: Displacements of %s exceed 32 bits\n", spec->name);
+    return false;
+  }
+
+  return true;
+}
+
+/* Bytes of buffer the memory operands of a spec can touch */
+size_t kernel_spec_buffer_size(const kernel_spec_t* spec) {
+  return spec->stride * (spec->count_end - 1) + 4096;
+}
+
+static size_t _kernel_offset(const kernel_t* kernel, size_t i) {
+  return kernel->body + (i / kernel->mix_length) * kernel->prefix[kernel->mix_length] +
+    kernel->prefix[i % kernel->mix_length];
+}
+
+static void _kernel_emit_end(kernel_t* kernel) {
+  emitter_seek(&kernel->emitter, _kernel_offset(kernel, kernel->count));
+  emit(&kernel->emitter, &EMIT_RDTSC);
+  emit(&kernel->emitter, &EMIT_MFENCE);
+  emit(&kernel->emitter, &EMIT_SHL_RDX_32);
+  emit(&kernel->emitter, &EMIT_OR_RAX_RDX);
+  emit(&kernel->emitter, &EMIT_SUB_RAX_R9);
+  emit(&kernel->emitter, &EMIT_RET);
+}
+
+/* Emits the measurement frame around zero instructions under test */
+void kernel_init(kernel_t* kernel, uint8_t* code, size_t size, const emitter_template_t* const* mix, size_t mix_length,
+    const emitter_template_t* fence, size_t stride) {
+  emitter_init(&kernel->emitter, code, size);
+  memcpy(kernel->mix, mix, mix_length * sizeof(mix[0]));
+  kernel->mix_length = mix_length;
+  kernel->fence = fence;
+  kernel->stride = stride;
+  kernel->count = 0;
+
+  kernel->prefix[0] = 0;
+  for (size_t i = 0; i < mix_length; i++) {
+    kernel->prefix[i + 1] = kernel->prefix[i] + mix[i]->length + (fence != NULL ? fence->length : 0);
+  }
+
+  emit(&kernel->emitter, &EMIT_MOV_R8_RDX);
+  emit(&kernel->emitter, &EMIT_CLFLUSH_R8);
+  emit(&kernel->emitter, &EMIT_LFENCE);
+  emit(&kernel->emitter, &EMIT_RDTSC);
+  emit(&kernel->emitter, &EMIT_SHL_RDX_32);
+  emit(&kernel->emitter, &EMIT_OR_RAX_RDX);
+  emit(&kernel->emitter, &EMIT_MOV_R9_RAX);
+  emit(&kernel->emitter, &EMIT_MOV_RAX_0);
+  emit(&kernel->emitter, &EMIT_MOVNTDQA_R8);
+  kernel->body = kernel->emitter.position;
+
+  _kernel_emit_end(kernel);
+}
+
+void kernel_init_spec(kernel_t* kernel, uint8_t* code, size_t size, const kernel_spec_t* spec) {
+  kernel_init(kernel, code, size, spec->mix, spec->mix_length, spec->fence, spec->stride);
+}
+
+/* Sets the number of instructions under test. Only the instructions added
+ * beyond the previous count and the end of the frame are written; shrinking
+ * the kernel rewrites the end of the frame only. */
+bool kernel_resize(kernel_t* kernel, size_t count) {
+  emitter_seek(&kernel->emitter, _kernel_offset(kernel, kernel->count));
+  for (size_t i = kernel->count; i < count; i++) {
+    emit_displacement(&kernel->emitter, kernel->mix[i % kernel->mix_length], i * kernel->stride);
+    if (kernel->fence != NULL) {
+      emit(&kernel->emitter, kernel->fence);
+    }
+  }
+  kernel->count = count;
+  _kernel_emit_end(kernel);
+
+  return (kernel->emitter.overflow == false);
+}
+
+/* Instructions between and including the two rdtsc */
+size_t kernel_instructions(const kernel_t* kernel) {
+  return FRAME_INSTRUCTIONS + kernel->count * (kernel->fence != NULL ? 2 : 1);
+}
+
+static inline kernel_function_t kernel_function(const kernel_t* kernel) {
+  return (kernel_function_t) kernel->emitter.code;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
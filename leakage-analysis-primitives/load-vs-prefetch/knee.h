@@ -0,0 +1,200 @@
+#ifndef KNEE_H
+#define KNEE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+
+/* Adaptive search for the capacity knee of a latency curve.
+ *
+ * The curve is sampled coarsely over the whole range, and a two-segment
+ * linear model is fitted for every possible change point. The change point
+ * with the smallest residual sum of squares is the knee. Its confidence
+ * interval contains every change point whose fit is not significantly worse
+ * (likelihood ratio n * log(SSE / SSE_min) below the chi-squared quantile).
+ * The interval is then sampled at every count with more tries, and the
+ * model is refitted until the interval is covered completely. */
+
+#define KNEE_MAX_SAMPLES 1024
+#define KNEE_COARSE_POINTS 16
+#define KNEE_REFINE_POINTS 32
+#define KNEE_MAX_ROUNDS 4
+#define KNEE_CHI2_95 3.841
+
+typedef float (*knee_measure_t)(size_t count, size_t tries, void* context);
+
+typedef struct knee_result_s {
+  size_t knee;          /* last count before the change point */
+  size_t low;           /* 95% confidence interval of the knee */
+  size_t high;
+  double slope_before;  /* cycles per instruction below and above the knee */
+  double slope_after;
+  size_t samples;
+  size_t invocations;   /* kernel runs, including all tries */
+} knee_result_t;
+
+typedef struct knee_search_s {
+  size_t counts[KNEE_MAX_SAMPLES];
+  float values[KNEE_MAX_SAMPLES];
+  size_t n;
+  size_t invocations;
+} knee_search_t;
+
+static bool _knee_sampled(const knee_search_t* search, size_t count) {
+  for (size_t i = 0; i < search->n; i++) {
+    if (search->counts[i] == count) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void _knee_sample(knee_search_t* search, size_t count, size_t tries, knee_measure_t measure, void* context) {
+  if (search->n == KNEE_MAX_SAMPLES || _knee_sampled(search, count)) {
+    return;
+  }
+
+  search->counts[search->n] = count;
+  search->values[search->n] = measure(count, tries, context);
+  search->n++;
+  search->invocations += tries;
+}
+
+/* Least-squares line through the samples with count in [low, high] */
+static double _knee_line(const knee_search_t* search, size_t low, size_t high, double* slope, size_t* n) {
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+  size_t m = 0;
+  for (size_t i = 0; i < search->n; i++) {
+    if (search->counts[i] < low || search->counts[i] > high) {
+      continue;
+    }
+    double x = search->counts[i], y = search->values[i];
+    sx += x; sy += y; sxx += x * x; sxy += x * y; syy += y * y;
+    m++;
+  }
+
+  *n = m;
+  if (m < 2) {
+    *slope = 0;
+    return 0;
+  }
+
+  double vxx = sxx - sx * sx / m;
+  double vxy = sxy - sx * sy / m;
+  double vyy = syy - sy * sy / m;
+  *slope = (vxx > 0) ? vxy / vxx : 0;
+
+  double sse = vyy - *slope * vxy;
+  return sse > 0 ? sse : 0;
+}
+
+/* Fits the two-segment model for every change point and updates result */
+static bool _knee_fit(const knee_search_t* search, size_t begin, size_t end, knee_result_t* result) {
+  double sse[KNEE_MAX_SAMPLES];
+  double best = INFINITY;
+  size_t best_index = 0;
+
+  for (size_t i = 0; i < search->n; i++) {
+    size_t b = search->counts[i];
+    double slope_before, slope_after;
+    size_t n_before, n_after;
+    sse[i] = _knee_line(search, begin, b, &slope_before, &n_before) +
+      _knee_line(search, b + 1, end, &slope_after, &n_after);
+    if (n_before < 2 || n_after < 2) {
+      sse[i] = INFINITY;
+      continue;
+    }
+    if (sse[i] < best) {
+      best = sse[i];
+      best_index = i;
+      result->slope_before = slope_before;
+      result->slope_after = slope_after;
+    }
+  }
+
+  if (isinf(best)) {
+    return false;
+  }
+
+  result->knee = search->counts[best_index];
+  result->low = result->knee;
+  result->high = result->knee;
+
+  double limit = (best > 0 ? best : DBL_MIN) * exp(KNEE_CHI2_95 / search->n);
+  for (size_t i = 0; i < search->n; i++) {
+    if (sse[i] <= limit) {
+      if (search->counts[i] < result->low) result->low = search->counts[i];
+      if (search->counts[i] > result->high) result->high = search->counts[i];
+    }
+  }
+
+  return true;
+}
+
+/* Largest sampled count below and smallest one above the given count */
+static void _knee_neighbours(const knee_search_t* search, size_t count, size_t begin, size_t end, size_t* below, size_t* above) {
+  *below = begin;
+  *above = end;
+  for (size_t i = 0; i < search->n; i++) {
+    size_t c = search->counts[i];
+    if (c < count && c > *below) *below = c;
+    if (c > count && c < *above) *above = c;
+  }
+}
+
+bool knee_search(size_t begin, size_t end, size_t coarse_tries, size_t fine_tries, knee_measure_t measure, void* context,
+    knee_result_t* result) {
+  static knee_search_t search;
+  search.n = 0;
+  search.invocations = 0;
+
+  if (end < begin + 4) {
+    return false;
+  }
+
+  /* Coarse pass over the whole range */
+  for (size_t i = 0; i < KNEE_COARSE_POINTS; i++) {
+    _knee_sample(&search, begin + (end - begin) * i / (KNEE_COARSE_POINTS - 1), coarse_tries, measure, context);
+  }
+  if (_knee_fit(&search, begin, end, result) == false) {
+    return false;
+  }
+
+  /* Refine around the confidence interval until every count in it is sampled */
+  for (size_t round = 0; round < KNEE_MAX_ROUNDS; round++) {
+    size_t low, high, unused;
+    _knee_neighbours(&search, result->low, begin, end, &low, &unused);
+    _knee_neighbours(&search, result->high, begin, end, &unused, &high);
+
+    size_t step = (high - low) / KNEE_REFINE_POINTS + 1;
+    size_t before = search.n;
+    for (size_t count = low; count <= high; count += step) {
+      _knee_sample(&search, count, fine_tries, measure, context);
+    }
+
+    if (_knee_fit(&search, begin, end, result) == false) {
+      return false;
+    }
+    if (search.n == before) {
+      break;
+    }
+  }
+
+  result->samples = search.n;
+  result->invocations = search.invocations;
+
+  return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,9 +8,11 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <float.h>
-#include <assemblyline.h>
+#include <getopt.h>
 
 #include "cacheutils.h"
+#include "kernel.h"
+#include "knee.h"
 
 #define COLOR_RED     "\x1b[31m"
 #define COLOR_GREEN   "\x1b[32m"
@@ -32,199 +34,413 @@
 #define WITH_LOAD (1)
 
 #define STEP_SIZE (4096)
-#define INPUT_SIZE (4096*16)
+#if SAME_ADDRESS == 1
+#define STRIDE (0)
+#else
+#define STRIDE (STEP_SIZE)
+#endif
 #define BUFFER_SIZE (4096*64)
 #define OUTLIER_THRESHOLD (20000)
 
 #define LENGTH(x) (sizeof(x)/sizeof((x)[0]))
 
-typedef size_t (*fnct_t)(size_t);
+#define MAX_KERNELS 64
+#define KERNELS_FILE "kernels.csv"
+
+/* Adaptive mode: tries per count in the coarse pass and in the refinement */
+#define KNEE_FILE "knee.csv"
+#define COARSE_TRIES (1000ull)
+#define FINE_TRIES (TRIES)
+
+/* Uncached setup: with more than SWEEP_LINES lines, an eviction buffer is
+ * swept instead of flushing the lines (0: always flush) */
+#define SWEEP_LINES (0)
+#define EVICTION_SIZE (64 * 1024 * 1024)
+
+/* Flush benchmark */
+#define FLUSH_FILE "flush.csv"
+#define FLUSH_REPETITIONS (1000)
+#define FLUSH_SWEEP_REPETITIONS (20)
 
 inline __attribute__((always_inline)) void cpuid(void) {
   asm volatile ("CPUID\n\t" :: "a"(0), "b"(0), "c"(0), "d"(0));
 }
 
-#define ADD_CODE(p, s) \
-{ \
-  size_t __l = strlen(s); \
-  memcpy(p, s, __l); \
-  p += __l; \
-  instruction_count++; \
-}
+/* Forward declarations */
+static void compute_statistics(float* values, size_t n, size_t* new_n, float* average, float* min, float* variance, float* std_deviation, float* std_error);
+
+static float results[TRIES];
+static char* eviction_buffer = NULL;
 
-#define ADD_CODE_NC(p, s) \
-{ \
-  size_t __l = strlen(s); \
-  memcpy(p, s, __l); \
-  p += __l; \
+static char* get_eviction_buffer(void) {
+  if (eviction_buffer == NULL) {
+    eviction_buffer = (char*) mmap(NULL, EVICTION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (eviction_buffer == MAP_FAILED) {
+      eviction_buffer = NULL;
+    }
+  }
+
+  return eviction_buffer;
 }
 
-#define MEASURE_BEGIN() \
-  ADD_CODE_NC(p, "mov r8, rdx\n"); \
-  ADD_CODE_NC(p, "clflush [r8]\n"); \
-  ADD_CODE_NC(p, "lfence\n"); \
-  ADD_CODE(p, "rdtsc\n"); \
-  ADD_CODE(p, "shl rdx, 0x20\n"); \
-  ADD_CODE(p, "or rax, rdx\n"); \
-  ADD_CODE(p, "mov r9, rax\n"); \
-  ADD_CODE(p, "mov rax, 0\n"); \
-  ADD_CODE(p, "movntdqa r10, [r8]\n");
-
-#define MEASURE_END() \
-  ADD_CODE(p, "rdtsc\n"); \
-  ADD_CODE_NC(p, "mfence\n"); \
-  ADD_CODE_NC(p, "shl rdx, 0x20\n"); \
-  ADD_CODE_NC(p, "or rax, rdx\n"); \
-  ADD_CODE_NC(p, "sub rax, r9\n"); \
-  ADD_CODE_NC(p, "ret\n");
-
-size_t create_code_nop(char* code_input, size_t rob_size)
-{
-  memset(code_input, 0, INPUT_SIZE);
+/* Runs a kernel tries times (at most TRIES); the count lines it accesses,
+ * stride bytes apart, are flushed (or accessed, if cached) before every run */
+float measure_fnc_tries(char* buffer, size_t count, size_t stride, bool cached, size_t tries, kernel_function_t fnc) {
+  size_t lines = (stride == 0) ? 1 : count;
+  if (tries > TRIES) {
+    tries = TRIES;
+  }
 
-  char* p = code_input;
-  size_t instruction_count = 0;
+  /* Clear results */
+  memset(results, 0, TRIES * sizeof(float));
 
-  MEASURE_BEGIN();
+  for (size_t try = 0; try < tries; try++) {
+    if (cached) {
+      for (size_t i = 0; i < lines; i++) {
+        maccess(buffer + i * stride);
+      }
+    } else if (SWEEP_LINES != 0 && lines > SWEEP_LINES && get_eviction_buffer() != NULL) {
+      evict_sweep(eviction_buffer, EVICTION_SIZE);
+    } else {
+      flush_range(buffer, lines, stride);
+    }
+    asm volatile("mfence");
+    asm volatile("lfence");
+    cpuid();
 
-  for (size_t i = 0; i < rob_size; i++) {
-    ADD_CODE(p, "nop\n");
+    size_t value = 0;
+    asm volatile(
+        "call *%[fnc]\n"
+        : "=a"(value) : [fnc]"p"(fnc), "d"(buffer) : "rbx", "rcx", "r8", "r9", "r10", "r15", "xmm10", "memory"
+        );
+    results[try] = value;
   }
 
-  MEASURE_END();
+  float average = 0, std_error = 0, min = 0;
+  size_t new_n = 0;
+  compute_statistics(results, tries, &new_n, &average, &min, NULL, NULL, &std_error);
 
-  return instruction_count;
+  return average;
 }
 
-size_t create_code_load(char* code_input, size_t rob_size)
-{
-  memset(code_input, 0, INPUT_SIZE);
-
-  char* p = code_input;
-  size_t instruction_count = 0;
-
-  MEASURE_BEGIN();
+float measure_fnc(char* buffer, size_t count, size_t stride, bool cached, kernel_function_t fnc) {
+  return measure_fnc_tries(buffer, count, stride, cached, TRIES, fnc);
+}
 
-  for (size_t i = 0; i < rob_size; i++) {
-#if SAME_ADDRESS == 1
-    ADD_CODE(p, "mov [r8], r15\n");
-#else
-    char _buffer[128] = {0};
-    sprintf(_buffer, "mov [r8 + 0x%x], r15\n", (unsigned int) i * 4096);
-    ADD_CODE(p, _buffer);
-#endif
+typedef struct adaptive_context_s {
+  kernel_t* kernel;
+  char* buffer;
+  size_t stride;
+  bool cached;
+} adaptive_context_t;
+
+static float adaptive_measure(size_t count, size_t tries, void* context) {
+  adaptive_context_t* c = (adaptive_context_t*) context;
+  if (kernel_resize(c->kernel, count) == false) {
+    return NAN;
   }
 
-  MEASURE_END();
+  return measure_fnc_tries(c->buffer, count, c->stride, c->cached, tries, kernel_function(c->kernel));
+}
 
-  return instruction_count;
+/* Uncached setup variants compared by the flush benchmark */
+static const char* flush_methods[] = { "clflush", "flush_range", "sweep" };
+
+static void flush_with(size_t method, char* buffer, size_t n, size_t stride) {
+  switch (method) {
+    case 0:
+      for (size_t i = 0; i < n; i++) {
+        flush(buffer + i * stride);
+      }
+      mfence();
+      break;
+    case 1:
+      flush_range(buffer, n, stride);
+      break;
+    case 2:
+      evict_sweep(eviction_buffer, EVICTION_SIZE);
+      break;
+  }
 }
 
-size_t create_code_prefetch(char* code_input, size_t rob_size)
+/* Measures cost (cycles per setup) and effectiveness (fraction of probed
+ * lines that miss on a reload afterwards) of every setup variant */
+int flush_benchmark(void)
 {
-  memset(code_input, 0, INPUT_SIZE);
+  size_t buffer_size = LENGTH_END * STEP_SIZE;
+  char* buffer = (char*) mmap(NULL, buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (buffer == MAP_FAILED || get_eviction_buffer() == NULL) {
+    fprintf(stderr, "Error: Could not allocate buffer\n");
+    return -1;
+  }
+  memset(buffer, 0xAA, buffer_size);
 
-  char* p = code_input;
-  size_t instruction_count = 0;
+  FILE* f = fopen(FLUSH_FILE, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", FLUSH_FILE);
+    return -1;
+  }
+  fprintf(f, "Method,Lines,Cycles,CyclesPerLine,Evicted\n");
+
+  size_t threshold = detect_flush_reload_threshold();
+  fprintf(stderr, "clflushopt: %s, miss threshold: %zu cycles\n", has_clflushopt() ? "yes" : "no", threshold);
+
+  size_t counts[] = { 1, 16, 64, LENGTH_END };
+  for (size_t c = 0; c < LENGTH(counts); c++) {
+    size_t n = counts[c];
+    for (size_t method = 0; method < LENGTH(flush_methods); method++) {
+      size_t repetitions = (method == 2) ? FLUSH_SWEEP_REPETITIONS : FLUSH_REPETITIONS;
+      uint64_t cycles = 0;
+      size_t evicted = 0;
+
+      for (size_t r = 0; r < repetitions; r++) {
+        for (size_t i = 0; i < n; i++) {
+          maccess(buffer + i * STEP_SIZE);
+        }
+        mfence();
+
+        uint64_t begin = rdtsc();
+        flush_with(method, buffer, n, STEP_SIZE);
+        uint64_t end = rdtsc();
+        cycles += end - begin;
+
+        /* Probe one line per repetition so that earlier reloads do not
+         * interfere */
+        evicted += ((size_t) reload_t(buffer + (r % n) * STEP_SIZE) > threshold);
+      }
+
+      double per_call = (double) cycles / repetitions;
+      double rate = (double) evicted / repetitions;
+      fprintf(stderr, "%-12s %4zu lines: %10.1f cycles (%7.1f per line), %6.2f%% evicted\n",
+          flush_methods[method], n, per_call, per_call / n, rate * 100);
+      fprintf(f, "%s,%zu,%.1f,%.2f,%.4f\n", flush_methods[method], n, per_call, per_call / n, rate);
+    }
+  }
 
-  MEASURE_BEGIN();
+  fclose(f);
+  munmap(buffer, buffer_size);
 
-  for (size_t i = 0; i < rob_size; i++) {
-#if SAME_ADDRESS == 1
-    ADD_CODE(p, "prefetcht0 [rdi]\n");
-#else
-    char _buffer[128] = {0};
-    sprintf(_buffer, "prefetcht0 [rdi + 0x%x]\n", (unsigned int) (i * STEP_SIZE));
-    ADD_CODE(p, _buffer);
-#endif
-  }
+  return 0;
+}
 
-  MEASURE_END();
+FILE* open_knee_file(void)
+{
+  FILE* f = fopen(KNEE_FILE, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", KNEE_FILE);
+    return NULL;
+  }
+  fprintf(f, "Kernel,Knee,Low,High,Index,SlopeBefore,SlopeAfter,Samples,Invocations,BruteForce\n");
 
-  return instruction_count;
+  return f;
 }
 
-void create_code_prefetchnta(char* code_input, size_t rob_size)
+/* Finds the capacity knee of a kernel between begin and end instructions
+ * and writes it to f */
+bool run_adaptive(FILE* f, const char* name, kernel_t* kernel, char* buffer, size_t stride, bool cached, size_t begin, size_t end)
 {
-  memset(code_input, 0, INPUT_SIZE);
+  adaptive_context_t context = {
+    .kernel = kernel,
+    .buffer = buffer,
+    .stride = stride,
+    .cached = cached
+  };
+
+  knee_result_t result;
+  if (knee_search(begin, end, COARSE_TRIES, FINE_TRIES, adaptive_measure, &context, &result) == false) {
+    fprintf(stderr, COLOR_YELLOW "Warning: No knee found for %s\n" COLOR_RESET, name);
+    return false;
+  }
 
-  char* p = code_input;
-#if SAME_ADDRESS == 1
-  const char* c3 = "prefetchnta [rdi];\n";
-#else
-  const char* c3 = "prefetchnta [rdi + 0x%x];\n";
-#endif
-  size_t l = strlen(c3);
-  size_t written = 0;
-  for (size_t i = 0; i < rob_size; i++) {
-    size_t offset = i * STEP_SIZE;
-    char _buffer[128] = {0};
-    sprintf(_buffer, c3, offset);
-    l = strlen(_buffer);
-    memcpy(p + written, _buffer, l);
-    written += l;
-  }
-  memcpy(p + written, "ret\n", 4);
+  kernel_resize(kernel, result.knee);
+  size_t brute_force = (end - begin + 1) * TRIES;
+
+  fprintf(stderr, COLOR_GREEN "%s: knee at %zu instructions (95%% CI %zu-%zu, index %zu), %.2f -> %.2f cycles/instruction, "
+      "%zu kernel runs (%.1f%% of brute force)\n" COLOR_RESET, name, result.knee, result.low, result.high,
+      kernel_instructions(kernel), result.slope_before, result.slope_after, result.invocations,
+      100.0 * result.invocations / brute_force);
+  fprintf(f, "%s,%zu,%zu,%zu,%zu,%.3f,%.3f,%zu,%zu,%zu\n", name, result.knee, result.low, result.high,
+      kernel_instructions(kernel), result.slope_before, result.slope_after, result.samples, result.invocations, brute_force);
+
+  return true;
 }
 
-/* Forward declarations */
-static void compute_statistics(float* values, size_t n, size_t* new_n, float* average, float* min, float* variance, float* std_deviation, float* std_error);
+/* Runs every count of every spec, largest count first, and writes one row
+ * per kernel and count; in adaptive mode, searches the knee of every spec
+ * instead */
+int run_specs(kernel_spec_t* specs, size_t n, const char* path, bool adaptive)
+{
+  size_t buffer_size = 4096;
+  for (size_t i = 0; i < n; i++) {
+    if (kernel_spec_buffer_size(&specs[i]) > buffer_size) {
+      buffer_size = kernel_spec_buffer_size(&specs[i]);
+    }
+  }
 
-static float results[TRIES];
+  char* buffer = (char*) mmap(NULL, buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (buffer == MAP_FAILED) {
+    fprintf(stderr, "Error: Could not allocate buffer\n");
+    return -1;
+  }
+  memset(buffer, 0xAA, buffer_size);
 
-float measure_fnc(char* buffer, size_t rob_size, fnct_t fnc) {
-  /* Clear results */
-  memset(results, 0, TRIES * sizeof(float));
+  uint8_t *code_buffer = mmap(NULL, sizeof(uint8_t) * BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (code_buffer == MAP_FAILED) {
+    fprintf(stderr, "Error: Could not allocate code buffer\n");
+    return -1;
+  }
 
-  for (size_t try = 0; try < TRIES; try++) {
-#if CACHED == 0
-#if SAME_ADDRESS == 1
-    flush(buffer);
-#else
-    for (size_t i = 0; i < rob_size; i++) {
-      flush(buffer + i * STEP_SIZE);
+  FILE* f = adaptive ? open_knee_file() : fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", adaptive ? KNEE_FILE : path);
+    return -1;
+  }
+  if (adaptive == false) {
+    fprintf(f, "Kernel,Count,Index,Cycles\n");
+  }
+
+  for (size_t k = 0; k < n; k++) {
+    kernel_spec_t* spec = &specs[k];
+    kernel_t kernel;
+    kernel_init_spec(&kernel, code_buffer, BUFFER_SIZE, spec);
+
+    if (adaptive) {
+      if (kernel_resize(&kernel, spec->count_end) == false) {
+        fprintf(stderr, "Error: Code buffer too small for %zu instructions of %s\n", spec->count_end, spec->name);
+        return -1;
+      }
+      run_adaptive(f, spec->name, &kernel, buffer, spec->stride, spec->cached, spec->count_begin, spec->count_end);
+      continue;
     }
-#endif
-#else
-#if SAME_ADDRESS == 1
-    maccess(buffer);
-#else
-    for (size_t i = 0; i < rob_size; i++) {
-      maccess(buffer + i * STEP_SIZE);
+
+    size_t steps = (spec->count_end - spec->count_begin) / spec->count_step;
+    for (size_t step = steps + 1; step-- > 0; ) {
+      size_t count = spec->count_begin + step * spec->count_step;
+      if (kernel_resize(&kernel, count) == false) {
+        fprintf(stderr, "Error: Code buffer too small for %zu instructions of %s\n", count, spec->name);
+        return -1;
+      }
+
+      float result = measure_fnc(buffer, count, spec->stride, spec->cached, kernel_function(&kernel));
+      fprintf(stderr, "%s %4zu: %10.3f\n", spec->name, kernel_instructions(&kernel), result);
+      fprintf(f, "%s,%zu,%zu,%.3f\n", spec->name, count, kernel_instructions(&kernel), result);
     }
-#endif
-#endif
-    asm volatile("mfence");
-    asm volatile("lfence");
-    cpuid();
+  }
 
-    size_t value = 0;
-    asm volatile(
-        "call *%[fnc]\n"
-        : "=a"(value) : [fnc]"p"(fnc), "d"(buffer) : "rbx", "rcx", "r8", "r9", "r10"
-        );
-    results[try] = value;
+  fclose(f);
+  munmap(code_buffer, BUFFER_SIZE);
+  munmap(buffer, buffer_size);
+
+  return 0;
+}
+
+/* Reads one spec per line; empty lines and lines starting with # are skipped */
+bool read_specs(const char* path, kernel_spec_t* specs, size_t* n)
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", path);
+    return false;
   }
 
-  float average = 0, std_error = 0, min = 0;
-  size_t new_n = 0;
-  compute_statistics(results, TRIES, &new_n, &average, &min, NULL, NULL, &std_error);
+  char line[1024];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char* p = line + strspn(line, " \t");
+    if (*p == '\0' || *p == '\n' || *p == '#') {
+      continue;
+    }
+    if (*n == MAX_KERNELS) {
+      fprintf(stderr, "Error: At most %d kernels\n", MAX_KERNELS);
+      fclose(f);
+      return false;
+    }
+    if (kernel_spec_parse(&specs[*n], p) == false) {
+      fclose(f);
+      return false;
+    }
+    (*n)++;
+  }
 
-  return average;
+  fclose(f);
+  return true;
+}
+
+static void print_help(char* argv[]) {
+  fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
+  fprintf(stdout, "\t-k, -kernel <spec>\t Measure a generated kernel (repeatable), e.g.\n");
+  fprintf(stdout, "\t\t\t\t 'name=prefetch ops=prefetcht0 stride=4096 count=1..256 setup=uncached fence=none'\n");
+  fprintf(stdout, "\t-f, -file <file>\t Read kernel specs from a file, one per line\n");
+  fprintf(stdout, "\t-o, -output <file>\t Output for kernel specs (default: " KERNELS_FILE ")\n");
+  fprintf(stdout, "\t-F, -flush-benchmark\t Measure cost and effectiveness of the uncached setup (" FLUSH_FILE ")\n");
+  fprintf(stdout, "\t-a, -adaptive\t\t Search the capacity knee of every kernel instead of measuring every count (" KNEE_FILE ")\n");
+  fprintf(stdout, "\t-h, -help\t\t Help page\n");
+  fprintf(stdout, "Without kernel specs, the load, prefetch and nop kernels are measured (log.csv).\n");
 }
 
 int main(int argc, char* argv[])
 {
+  static kernel_spec_t specs[MAX_KERNELS];
+  size_t number_of_specs = 0;
+  const char* output = KERNELS_FILE;
+  bool adaptive = false;
+
+  static const char* short_options = "k:f:o:aFh";
+  static struct option long_options[] = {
+    {"kernel",          required_argument, NULL, 'k'},
+    {"file",            required_argument, NULL, 'f'},
+    {"output",          required_argument, NULL, 'o'},
+    {"adaptive",        no_argument,       NULL, 'a'},
+    {"flush-benchmark", no_argument,       NULL, 'F'},
+    {"help",            no_argument,       NULL, 'h'},
+    { NULL,             0, NULL, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+    switch (c) {
+      case 'k':
+        if (number_of_specs == MAX_KERNELS) {
+          fprintf(stderr, "Error: At most %d kernels\n", MAX_KERNELS);
+          return -1;
+        }
+        if (kernel_spec_parse(&specs[number_of_specs], optarg) == false) {
+          return -1;
+        }
+        number_of_specs++;
+        break;
+      case 'f':
+        if (read_specs(optarg, specs, &number_of_specs) == false) {
+          return -1;
+        }
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'a':
+        adaptive = true;
+        break;
+      case 'F':
+        return flush_benchmark();
+      case 'h':
+        print_help(argv);
+        return 0;
+      case ':':
+        fprintf(stderr, "Error: option `-%c' requires an argument\n", optopt);
+        break;
+      case '?':
+      default:
+        fprintf(stderr, "Error: Invalid option '-%c'\n", optopt);
+        return -1;
+    }
+  }
+
+  if (number_of_specs > 0) {
+    return run_specs(specs, number_of_specs, output, adaptive);
+  }
+
   size_t number_of_pages = (LENGTH_END - LENGTH_BEGIN) + 1;
   size_t buffer_size = 4096 * number_of_pages;
 
-  FILE* f = fopen("log.csv", "w");
-#if WITH_PREFETCH_NTA == 1
-  fprintf(f, "Index,Load,Prefetch,PrefetchNTA,NOP\n");
-#else
-  fprintf(f, "Index,Load,Prefetch,NOP\n");
-#endif
-
   char* buffer = (char*) mmap(NULL, buffer_size, PROT_READ | PROT_WRITE | PROT_NONE, MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
   if (buffer == MAP_FAILED) {
     fprintf(stderr, "Error: Could not allocate buffer\n");
@@ -239,60 +455,77 @@ int main(int argc, char* argv[])
     return -1;
   }
 
-  /* Blah */
-  char*code_input = mmap(NULL, INPUT_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  if (code_input == MAP_FAILED) {
-    fprintf(stderr, "Failed to allocate buffer\n");
-    return -1;
+  /* One kernel per variant, each in its own part of the code buffer */
+  kernel_t kernel_nop, kernel_load, kernel_prefetch, kernel_prefetchnta;
+  kernel_init(&kernel_nop, code_buffer + 0 * (BUFFER_SIZE / 4), BUFFER_SIZE / 4,
+      (const emitter_template_t*[]) { &EMIT_NOP }, 1, NULL, STRIDE);
+  kernel_init(&kernel_load, code_buffer + 1 * (BUFFER_SIZE / 4), BUFFER_SIZE / 4,
+      (const emitter_template_t*[]) { &EMIT_STORE_R8 }, 1, NULL, STRIDE);
+  kernel_init(&kernel_prefetch, code_buffer + 2 * (BUFFER_SIZE / 4), BUFFER_SIZE / 4,
+      (const emitter_template_t*[]) { &EMIT_PREFETCHT0_RDI }, 1, NULL, STRIDE);
+  kernel_init(&kernel_prefetchnta, code_buffer + 3 * (BUFFER_SIZE / 4), BUFFER_SIZE / 4,
+      (const emitter_template_t*[]) { &EMIT_PREFETCHNTA_RDI }, 1, NULL, STRIDE);
+
+  if (adaptive) {
+    FILE* knee = open_knee_file();
+    if (knee == NULL) {
+      return -1;
+    }
+    kernel_resize(&kernel_nop, LENGTH_END);
+    run_adaptive(knee, "NOP", &kernel_nop, buffer, STRIDE, CACHED, LENGTH_BEGIN, LENGTH_END);
+#if WITH_LOAD == 1
+    kernel_resize(&kernel_load, LENGTH_END);
+    run_adaptive(knee, "Load", &kernel_load, buffer, STRIDE, CACHED, LENGTH_BEGIN, LENGTH_END);
+#endif
+#if WITH_PREFETCH == 1
+    kernel_resize(&kernel_prefetch, LENGTH_END);
+    run_adaptive(knee, "Prefetch", &kernel_prefetch, buffer, STRIDE, CACHED, LENGTH_BEGIN, LENGTH_END);
+#endif
+#if WITH_PREFETCH_NTA == 1
+    kernel_resize(&kernel_prefetchnta, LENGTH_END);
+    run_adaptive(knee, "PrefetchNTA", &kernel_prefetchnta, buffer, STRIDE, CACHED, LENGTH_BEGIN, LENGTH_END);
+#endif
+    fclose(knee);
+    munmap(code_buffer, BUFFER_SIZE);
+    munmap(buffer, buffer_size);
+    return 0;
   }
 
+  FILE* f = fopen("log.csv", "w");
+#if WITH_PREFETCH_NTA == 1
+  fprintf(f, "Index,Load,Prefetch,PrefetchNTA,NOP\n");
+#else
+  fprintf(f, "Index,Load,Prefetch,NOP\n");
+#endif
+
   /* Run measurements */
   for (size_t rob_size = LENGTH_END; rob_size >= LENGTH_BEGIN; rob_size--) {
-    assemblyline_t al = asm_create_instance(code_buffer, BUFFER_SIZE);
-    memset(code_input, 0, INPUT_SIZE);
-    size_t offset = create_code_nop(code_input, rob_size);
-    assemble_str(al, code_input);
-
-    fnct_t fnc = (fnct_t) asm_get_code(al);
+    if (kernel_resize(&kernel_nop, rob_size) == false || kernel_resize(&kernel_load, rob_size) == false ||
+        kernel_resize(&kernel_prefetch, rob_size) == false || kernel_resize(&kernel_prefetchnta, rob_size) == false) {
+      fprintf(stderr, "Error: Code buffer too small for %zu instructions\n", rob_size);
+      return -1;
+    }
+    size_t offset = kernel_instructions(&kernel_nop);
 
-    float result_nop = measure_fnc(buffer, rob_size, fnc);
-    asm_destroy_instance(al);
+    float result_nop = measure_fnc(buffer, rob_size, STRIDE, CACHED, kernel_function(&kernel_nop));
 
     /* Load */
 #if WITH_LOAD == 1
-    al = asm_create_instance(code_buffer, BUFFER_SIZE);
-    create_code_load(code_input, rob_size);
-    assemble_str(al, code_input);
-    fnc = (fnct_t) asm_get_code(al);
-
-    float result_load = measure_fnc(buffer, rob_size, fnc);
-    asm_destroy_instance(al);
+    float result_load = measure_fnc(buffer, rob_size, STRIDE, CACHED, kernel_function(&kernel_load));
 #else
     float result_load = 0.0;
 #endif
 
     /* Prefetch */
 #if WITH_PREFETCH == 1
-    al = asm_create_instance(code_buffer, BUFFER_SIZE);
-    create_code_prefetch(code_input, rob_size);
-    assemble_str(al, code_input);
-    fnc = (fnct_t) asm_get_code(al);
-
-    float result_prefetch = measure_fnc(buffer, rob_size, fnc);
-    asm_destroy_instance(al);
+    float result_prefetch = measure_fnc(buffer, rob_size, STRIDE, CACHED, kernel_function(&kernel_prefetch));
 #else
     float result_prefetch = 0.0;
 #endif
 
     /* Prefetch */
 #if WITH_PREFETCH_NTA == 1
-    al = asm_create_instance(code_buffer, BUFFER_SIZE);
-    create_code_prefetchnta(code_input, rob_size);
-    assemble_str(al, code_input);
-    fnc = (fnct_t) asm_get_code(al);
-
-    float result_prefetchnta = measure_fnc(buffer, rob_size, fnc);
-    asm_destroy_instance(al);
+    float result_prefetchnta = measure_fnc(buffer, rob_size, STRIDE, CACHED, kernel_function(&kernel_prefetchnta));
 #endif
 
     /* Show results */
@@ -307,6 +540,7 @@ int main(int argc, char* argv[])
 #endif
 
   /* Cleanup */
+  munmap(code_buffer, BUFFER_SIZE);
   munmap(buffer, buffer_size);
   fclose(f);
 
@@ -4,9 +4,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <getopt.h>
+#include <sys/mman.h>
 
 #include "ptedit_header.h"
+#include "page-table.h"
 #include "cacheutils.h"
+#include "streaming.h"
 
 #define TRIES 10000000
 #define AVG 1 //50000
@@ -14,7 +18,25 @@
 #define LEVELS 4  // 4 = all
 
 /* Alternative metrics: min, max */
-#define METRIC (sum / TRIES) // min 
+#define METRIC (sum / n) // min 
+
+/* With WITH_STREAMING, samples are not stored; a level stops early once the
+ * standard error of the mean is below TARGET_ERROR cycles, checked every
+ * CHECK_INTERVAL samples after MIN_TRIES */
+#ifndef TARGET_ERROR
+#define TARGET_ERROR 0.05
+#endif
+#define MIN_TRIES 100000
+#define CHECK_INTERVAL 10000
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define SWEEP_FILE "sweep.csv"
 
 inline __attribute__((always_inline)) void prefetch(size_t p) {
   asm volatile("mfence");
@@ -22,10 +44,13 @@ inline __attribute__((always_inline)) void prefetch(size_t p) {
   asm volatile("mfence");
 }
 
+#if WITH_STREAMING == 1
+streaming_t accumulator;
+#else
 size_t measurements[TRIES];
 
-size_t mean(size_t* val, size_t len) {
-    size_t sum = 0;
+double mean(size_t* val, size_t len) {
+    double sum = 0;
     for(size_t i = 0; i < len; i++) {
         sum += val[i];
     }
@@ -33,20 +58,25 @@ size_t mean(size_t* val, size_t len) {
 }
 
 double standard_error(size_t* val, size_t len) {
-    size_t m = mean(val, len);
-    size_t err_sum = 0;
+    double m = mean(val, len);
+    double err_sum = 0;
     for(size_t i = 0; i < len; i++) {
         err_sum += (val[i] - m) * (val[i] - m);
     }
-    double stddev = sqrt((double)err_sum / (double)(len - 1));
+    double stddev = sqrt(err_sum / (double)(len - 1));
     return stddev / sqrt(len);
 }
+#endif
 
 
 size_t measure(void* addr, double* err) {
   size_t address = (size_t) addr;
   uint64_t begin = 0, end = 0, min = 0, sum = 0, max = 0;
+  size_t n = 0;
   ptedit_invalidate_tlb((void*) address);
+#if WITH_STREAMING == 1
+  streaming_init(&accumulator);
+#endif
     
   for (size_t i = 0; i < TRIES; i++) {
     /* Begin measurement */
@@ -63,15 +93,29 @@ size_t measure(void* addr, double* err) {
     if(end - begin < min || !min) min = end - begin;
     if(end - begin > max) max = end - begin;
     sum += (end - begin);
+    n++;
+#if WITH_STREAMING == 1
+    streaming_add(&accumulator, (end - begin) / (AVG));
+    if (n >= MIN_TRIES && n % CHECK_INTERVAL == 0 && streaming_standard_error(&accumulator) < TARGET_ERROR) {
+      break;
+    }
+#else
     measurements[i] = (end - begin) / (AVG);
+#endif
   }
   
   min /= (AVG);
   max /= (AVG);
   sum /= (AVG);
 
+#if WITH_STREAMING == 1
+  *err = streaming_standard_error(&accumulator);
+  printf("\nPrefetch time: %5zd +/-%1.f (n: %zu, median: %zu, sigma: %.2f)\n", METRIC, *err, n,
+      streaming_quantile(&accumulator, 0.5), sqrt(streaming_variance(&accumulator)));
+#else
   *err = standard_error(measurements, TRIES);
   printf("\nPrefetch time: %5zd +/-%1.f\n", METRIC, *err);
+#endif
 
   return METRIC;
 }
@@ -115,35 +159,207 @@ void ptedit_print_present_levels(ptedit_entry_t entry) {
     }
 }
 
+typedef struct page_size_s {
+    const char* name;
+    size_t size;
+    int hugetlb;        /* mmap flags for hugetlbfs, 0 for base pages */
+    bool thp;           /* fall back to transparent huge pages */
+} page_size_t;
+
+static page_size_t page_sizes[] = {
+    { "4K", 4096ull,     0,                          false },
+    { "2M", 2ull << 20,  MAP_HUGETLB | MAP_HUGE_2MB, true  },
+    { "1G", 1ull << 30,  MAP_HUGETLB | MAP_HUGE_1GB, false },
+};
+
+typedef struct sweep_row_s {
+    const char* page_size;
+    const char* source;
+    page_table_level_t level;   /* level at which the walk terminates */
+    bool present;               /* walk ends in a mapped (kernel) page */
+    size_t cycles;
+    double error;
+} sweep_row_t;
+
+/* Maps one page of the given size at start; NULL if the size is not available */
+char* map_page(size_t start, const page_size_t* page_size, const char** source) {
+    char* buffer = MAP_FAILED;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+
+    if (page_size->hugetlb != 0) {
+        buffer = mmap((void*) start, page_size->size, PROT_READ | PROT_WRITE, flags | page_size->hugetlb, -1, 0);
+        *source = "hugetlbfs";
+    }
+    if (buffer == MAP_FAILED && (page_size->hugetlb == 0 || page_size->thp)) {
+        buffer = mmap((void*) start, page_size->size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (buffer != MAP_FAILED && page_size->thp) {
+            madvise(buffer, page_size->size, MADV_HUGEPAGE);
+            *source = "thp";
+        } else {
+            *source = "base";
+        }
+    }
+    if (buffer == MAP_FAILED) {
+        return NULL;
+    }
+    if ((size_t) buffer != start) {
+        munmap(buffer, page_size->size);
+        return NULL;
+    }
+
+    /* Fault in the page; a single write populates a whole huge page */
+    buffer[0] = 1;
+
+    return buffer;
+}
+
+void sweep_measure(sweep_row_t* row, const page_size_t* page_size, const char* source, page_table_level_t level,
+        bool present, size_t target) {
+    printf("\n\n%s page, %s %s: address %p\n", page_size->name, page_table_level_name(level),
+        present ? "maps the page" : "not present", (void*) target);
+
+    row->page_size = page_size->name;
+    row->source = source;
+    row->level = level;
+    row->present = present;
+    row->cycles = measure((void*) target, &row->error);
+}
+
+/* Measures the walk for every level at which it can terminate, for one page
+ * size: the mapped page itself, and an address with a non-present entry at
+ * every level from the leaf table up to the root */
+size_t sweep_page_size(size_t start, const page_size_t* page_size, sweep_row_t* rows) {
+    const char* source = NULL;
+    char* buffer = map_page(start, page_size, &source);
+    if (buffer == NULL) {
+        printf("Warning: %s pages are not available, skipping\n", page_size->name);
+        return 0;
+    }
+
+    page_table_t leaf;
+    if (page_table_read_leaf(&leaf, start, 0) == false ||
+        (1ull << page_table_shift(leaf.level)) != page_size->size) {
+        printf("Warning: %s mapping is not backed by a %s page, skipping\n", page_size->name, page_size->name);
+        munmap(buffer, page_size->size);
+        return 0;
+    }
+
+    /* Make the page a kernel page */
+    size_t index = page_table_index(leaf.level, start);
+    size_t original = leaf.entries[index].raw;
+    if (page_table_write_entry(&leaf, index, original & ~(1ull << PTEDIT_PAGE_BIT_USER)) == false) {
+        printf("Warning: Could not map the %s table, skipping\n", page_table_level_name(leaf.level));
+        munmap(buffer, page_size->size);
+        return 0;
+    }
+    ptedit_invalidate_tlb((void*) start);
+
+    size_t n = 0;
+    sweep_measure(&rows[n++], page_size, source, leaf.level, true, start);
+    for (int level = leaf.level; level >= PAGE_TABLE_LEVEL_PGD; level--) {
+        if (page_table_has_level(level)) {
+            sweep_measure(&rows[n++], page_size, source, level, false, start + (1ull << page_table_shift(level)));
+        }
+    }
+
+    page_table_write_entry(&leaf, index, original);
+    ptedit_invalidate_tlb((void*) start);
+    munmap(buffer, page_size->size);
+
+    return n;
+}
+
+int sweep(size_t start, bool la57) {
+    sweep_row_t rows[sizeof(page_sizes) / sizeof(page_sizes[0]) * (PAGE_TABLE_LEVELS + 1)];
+    size_t n = 0;
+
+    for (size_t i = 0; i < sizeof(page_sizes) / sizeof(page_sizes[0]); i++) {
+        n += sweep_page_size(start, &page_sizes[i], rows + n);
+    }
+
+    FILE* f = fopen(SWEEP_FILE, "w");
+    if (f == NULL) {
+        printf("Error: Could not open %s\n", SWEEP_FILE);
+        return 1;
+    }
+    fprintf(f, "paging_levels,page_size,source,level,present,cycles,error\n");
+
+    printf("\n\n%-6s %-9s %-10s %-5s %-8s %8s %8s\n", "paging", "page size", "source", "level", "present", "cycles", "error");
+    for (size_t i = 0; i < n; i++) {
+        sweep_row_t* r = &rows[i];
+        fprintf(f, "%d,%s,%s,%s,%d,%zu,%f\n", la57 ? 5 : 4, r->page_size, r->source,
+            page_table_level_name(r->level), r->present, r->cycles, r->error);
+        printf("%-6d %-9s %-10s %-5s %-8s %8zu %8.2f\n", la57 ? 5 : 4, r->page_size, r->source,
+            page_table_level_name(r->level), r->present ? "yes" : "no", r->cycles, r->error);
+    }
+    fclose(f);
+
+    printf("\nWritten to %s\n", SWEEP_FILE);
+
+    return 0;
+}
+
+static void print_help(char* argv[]) {
+    fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
+    fprintf(stdout, "\t-s, -sweep\t\t Measure every terminating level for 4K, 2M and 1G pages (" SWEEP_FILE ")\n");
+    fprintf(stdout, "\t-h, -help\t\t Help page\n");
+}
+
 int main(int argc, char* argv[]) {
+    bool run_sweep = false;
+
+    static const char* short_options = "sh";
+    static struct option long_options[] = {
+        {"sweep",           no_argument,       NULL, 's'},
+        {"help",            no_argument,       NULL, 'h'},
+        { NULL,             0, NULL, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+        switch (c) {
+            case 's':
+                run_sweep = true;
+                break;
+            case 'h':
+                print_help(argv);
+                return 0;
+            case '?':
+            default:
+                fprintf(stderr, "Error: Invalid option '-%c'\n", optopt);
+                return -1;
+        }
+    }
+
     /* Setup */
     if (ptedit_init()) {
         printf("Error: Could not initalize PTEditor, did you load the kernel module?\n");
         return 1;
     }
 
-    /* Find unused PML4 entry */
-    size_t start = 0;
-    
-    for(size_t i = 1; i < 512; i++) {
-        size_t current = start + i * 512ull * 1024ull * 1024ull * 1024ull;
-        printf("Checking %p...\n", current);
-        ptedit_entry_t entry = ptedit_resolve(current, 0);
-        ptedit_print_entry_t(entry);
-        int first = 0;
-        if(!ptedit_cast(entry.pte, ptedit_pgd_t).present) {
-            first = 1;
-        }
-        current = start + (i + 1) * 512ull * 1024ull * 1024ull * 1024ull;
-        printf("Checking next %p...\n", current);
-        entry = ptedit_resolve(current, 0);
-        ptedit_print_entry_t(entry);
-        if(!ptedit_cast(entry.pte, ptedit_pgd_t).present && first) {
-            start = start + i * 512ull * 1024ull * 1024ull * 1024ull;
-            break;
-        }
+    bool la57 = page_table_detect_la57();
+    printf("%d-level paging\n", la57 ? 5 : 4);
+
+    /* Find unused PML4 entry: two consecutive free entries in the user half */
+    page_table_t root;
+    if (page_table_read_root(&root, 0) == false) {
+        printf("Error: Could not read paging root\n");
+        return 1;
     }
+
+    ssize_t index = page_table_find_unused(&root, 1, PAGE_TABLE_ENTRIES / 2, 2);
+    if (index < 0) {
+        printf("Error: No unused PML4 entry\n");
+        return 1;
+    }
+    size_t start = index << page_table_shift(PAGE_TABLE_LEVEL_PGD);
     printf("Found unused PML4 entry at %p\n", start);
+
+    if (run_sweep) {
+        int result = sweep(start, la57);
+        ptedit_cleanup();
+        return result;
+    }
     
     char* buffer = (char*)mmap(start, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
     memset(buffer, 1, 4096);
@@ -152,6 +368,10 @@ int main(int argc, char* argv[]) {
     
     FILE* f = fopen("timing.csv", "w");
     fprintf(f, "level,tlb,errtlb\n");
+#if WITH_STREAMING == 1
+    FILE* histogram = fopen("histogram.csv", "w");
+    fprintf(histogram, "level,cycles,count\n");
+#endif
     
     for(int i = 0; i < LEVELS; i++) {
         size_t target = start + page_level_offset(i);
@@ -162,9 +382,15 @@ int main(int argc, char* argv[]) {
         double cached_err;
         size_t cached = measure(target, &cached_err);
         fprintf(f, "%d,%zd,%f\n", i, cached, cached_err);
+#if WITH_STREAMING == 1
+        streaming_write_histogram(&accumulator, histogram, i);
+#endif
     }
     
     fclose(f);
+#if WITH_STREAMING == 1
+    fclose(histogram);
+#endif
 
 
   /* Clean-up */
@@ -0,0 +1,289 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+/* Bulk access to whole page-table pages. Instead of resolving one address
+ * per ioctl, a table is read with a single physical page read and all of
+ * its entries are decoded at once.
+ *
+ * ptedit_header.h has no include guard and must be included before. */
+
+#define PAGE_TABLE_ENTRIES 512
+
+typedef enum page_table_level_e {
+  PAGE_TABLE_LEVEL_PGD = 0,
+  PAGE_TABLE_LEVEL_P4D,
+  PAGE_TABLE_LEVEL_PUD,
+  PAGE_TABLE_LEVEL_PMD,
+  PAGE_TABLE_LEVEL_PT,
+  PAGE_TABLE_LEVELS
+} page_table_level_t;
+
+static const char* page_table_level_names[] = {
+  [PAGE_TABLE_LEVEL_PGD] = "PGD",
+  [PAGE_TABLE_LEVEL_P4D] = "P4D",
+  [PAGE_TABLE_LEVEL_PUD] = "PUD",
+  [PAGE_TABLE_LEVEL_PMD] = "PMD",
+  [PAGE_TABLE_LEVEL_PT]  = "PT",
+};
+
+typedef struct page_table_entry_s {
+  size_t raw;
+  size_t pfn;
+  bool present;
+  bool writeable;
+  bool user_access;
+  bool accessed;
+  bool dirty;
+  bool size;
+  bool global;
+  bool execution_disabled;
+} page_table_entry_t;
+
+typedef struct page_table_s {
+  page_table_level_t level;
+  size_t pfn;
+  size_t base;          /* first virtual address covered by the table */
+  page_table_entry_t entries[PAGE_TABLE_ENTRIES];
+} page_table_t;
+
+bool page_table_has_level(page_table_level_t level) {
+  switch (level) {
+    case PAGE_TABLE_LEVEL_PGD: return ptedit_paging_definition.has_pgd;
+    case PAGE_TABLE_LEVEL_P4D: return ptedit_paging_definition.has_p4d;
+    case PAGE_TABLE_LEVEL_PUD: return ptedit_paging_definition.has_pud;
+    case PAGE_TABLE_LEVEL_PMD: return ptedit_paging_definition.has_pmd;
+    case PAGE_TABLE_LEVEL_PT:  return ptedit_paging_definition.has_pt;
+    default:                   return false;
+  }
+}
+
+const char* page_table_level_name(page_table_level_t level) {
+  return page_table_level_names[level];
+}
+
+/* Virtual address bits below the index of the given level */
+size_t page_table_shift(page_table_level_t level) {
+  size_t shift = ptedit_paging_definition.page_offset;
+
+  if (level < PAGE_TABLE_LEVEL_PT) {
+    shift += ptedit_paging_definition.pt_entries;
+  }
+  if (level < PAGE_TABLE_LEVEL_PMD && ptedit_paging_definition.has_pmd) {
+    shift += ptedit_paging_definition.pmd_entries;
+  }
+  if (level < PAGE_TABLE_LEVEL_PUD && ptedit_paging_definition.has_pud) {
+    shift += ptedit_paging_definition.pud_entries;
+  }
+  if (level < PAGE_TABLE_LEVEL_P4D && ptedit_paging_definition.has_p4d) {
+    shift += ptedit_paging_definition.p4d_entries;
+  }
+
+  return shift;
+}
+
+size_t page_table_index(page_table_level_t level, size_t address) {
+  return (address >> page_table_shift(level)) % PAGE_TABLE_ENTRIES;
+}
+
+page_table_entry_t page_table_decode(size_t raw) {
+  page_table_entry_t entry;
+
+  entry.raw = raw;
+  entry.pfn = ptedit_get_pfn(raw);
+  entry.present = ptedit_cast(raw, ptedit_pte_t).present;
+  entry.writeable = ptedit_cast(raw, ptedit_pte_t).writeable;
+  entry.user_access = ptedit_cast(raw, ptedit_pte_t).user_access;
+  entry.accessed = ptedit_cast(raw, ptedit_pte_t).accessed;
+  entry.dirty = ptedit_cast(raw, ptedit_pte_t).dirty;
+  entry.size = ptedit_cast(raw, ptedit_pte_t).size;
+  entry.global = ptedit_cast(raw, ptedit_pte_t).global;
+  entry.execution_disabled = ptedit_cast(raw, ptedit_pte_t).execution_disabled;
+
+  return entry;
+}
+
+static bool _page_table_read(page_table_t* table, page_table_level_t level, size_t pfn, size_t base) {
+  size_t raw[PAGE_TABLE_ENTRIES];
+  if (ptedit_get_pagesize() != sizeof(raw)) {
+    return false;
+  }
+
+  ptedit_read_physical_page(pfn, (char*) raw);
+
+  table->level = level;
+  table->pfn = pfn;
+  table->base = base;
+  for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+    table->entries[i] = page_table_decode(raw[i]);
+  }
+
+  return true;
+}
+
+/* Reads the paging root (PML4, or PML5 with LA57) of a process (0: self) */
+bool page_table_read_root(page_table_t* table, pid_t pid) {
+  size_t root = ptedit_get_paging_root(pid);
+  if (root == 0) {
+    return false;
+  }
+
+  return _page_table_read(table, PAGE_TABLE_LEVEL_PGD, ptedit_get_pfn(root), 0);
+}
+
+/* Reads the table referenced by an entry of parent; fails if the entry is not
+ * present or maps a large page */
+bool page_table_read_next(page_table_t* table, const page_table_t* parent, size_t index) {
+  const page_table_entry_t* entry = &parent->entries[index];
+  if (entry->present == false || parent->level == PAGE_TABLE_LEVEL_PT ||
+      (entry->size == true && parent->level != PAGE_TABLE_LEVEL_PGD)) {
+    return false;
+  }
+
+  page_table_level_t level = parent->level + 1;
+  while (level < PAGE_TABLE_LEVELS && page_table_has_level(level) == false) {
+    level++;
+  }
+  if (level == PAGE_TABLE_LEVELS) {
+    return false;
+  }
+
+  size_t base = parent->base + (index << page_table_shift(parent->level));
+
+  return _page_table_read(table, level, entry->pfn, base);
+}
+
+/* Reads the table of the given level that translates address */
+bool page_table_read_address(page_table_t* table, size_t address, page_table_level_t level, pid_t pid) {
+  if (page_table_read_root(table, pid) == false) {
+    return false;
+  }
+
+  while (table->level < level) {
+    page_table_t parent = *table;
+    if (page_table_read_next(table, &parent, page_table_index(parent.level, address)) == false) {
+      return false;
+    }
+  }
+
+  return (table->level == level);
+}
+
+/* First index in [first, last) that starts a run of count non-present
+ * entries, -1 if there is none */
+ssize_t page_table_find_unused(const page_table_t* table, size_t first, size_t last, size_t count) {
+  size_t run = 0;
+  for (size_t i = first; i < last && i < PAGE_TABLE_ENTRIES; i++) {
+    run = table->entries[i].present ? 0 : run + 1;
+    if (run == count) {
+      return i + 1 - count;
+    }
+  }
+
+  return -1;
+}
+
+/* Reads the table holding the entry that maps address: the PT for 4K pages,
+ * the PMD or PUD for large pages; fails if address is not mapped */
+bool page_table_read_leaf(page_table_t* table, size_t address, pid_t pid) {
+  if (page_table_read_root(table, pid) == false) {
+    return false;
+  }
+
+  while (true) {
+    const page_table_entry_t* entry = &table->entries[page_table_index(table->level, address)];
+    if (entry->present == false) {
+      return false;
+    }
+    if (table->level == PAGE_TABLE_LEVEL_PT || (entry->size == true && table->level != PAGE_TABLE_LEVEL_PGD)) {
+      return true;
+    }
+
+    page_table_t parent = *table;
+    if (page_table_read_next(table, &parent, page_table_index(parent.level, address)) == false) {
+      return false;
+    }
+  }
+}
+
+/* Writes one entry of a table through a mapping of its physical page; the
+ * caller has to invalidate the TLB */
+bool page_table_write_entry(page_table_t* table, size_t index, size_t raw) {
+  size_t pagesize = ptedit_get_pagesize();
+  volatile size_t* mapping = ptedit_pmap(table->pfn * pagesize, pagesize);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  mapping[index] = raw;
+  asm volatile("mfence");
+  munmap((void*) mapping, pagesize);
+
+  table->entries[index] = page_table_decode(raw);
+
+  return true;
+}
+
+/* PTEditor always assumes 4-level paging. If the kernel hands out addresses
+ * above 47 bits, 5-level paging (LA57) is active and the P4D level is
+ * enabled for the functions above. */
+bool page_table_detect_la57(void) {
+  void* probe = mmap((void*) (1ull << 48), 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (probe == MAP_FAILED) {
+    return false;
+  }
+  munmap(probe, 4096);
+
+  if ((size_t) probe < (1ull << 47)) {
+    return false;
+  }
+
+  ptedit_paging_definition.has_p4d = 1;
+  ptedit_paging_definition.p4d_entries = 9;
+
+  return true;
+}
+
+size_t page_table_count_present(const page_table_t* table) {
+  size_t n = 0;
+  for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+    n += table->entries[i].present;
+  }
+
+  return n;
+}
+
+/* One line per present entry */
+void page_table_print(const page_table_t* table, FILE* f) {
+  fprintf(f, "%s at pfn 0x%zx (base %p): %zu present\n", page_table_level_name(table->level), table->pfn,
+      (void*) table->base, page_table_count_present(table));
+
+  for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+    const page_table_entry_t* e = &table->entries[i];
+    if (e->present == false) {
+      continue;
+    }
+
+    fprintf(f, "  %3zu: %p -> pfn 0x%9zx %c%c%c%c%c%c%c\n", i,
+        (void*) (table->base + (i << page_table_shift(table->level))), e->pfn,
+        e->writeable ? 'W' : '-', e->user_access ? 'U' : '-', e->accessed ? 'A' : '-',
+        e->dirty ? 'D' : '-', e->size ? 'L' : '-', e->global ? 'G' : '-',
+        e->execution_disabled ? '-' : 'X');
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
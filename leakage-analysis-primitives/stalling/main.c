@@ -1,15 +1,35 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "cacheutils.h"
 #include <time.h>
+#include <sys/mman.h>
 
+#ifndef REPEAT
 #define REPEAT 1000000
+#endif
 
-inline __attribute__((always_inline)) void prefetch(void* p) {
-  /* asm volatile ("prefetchnta (%0)" : : "r" (p)); */
-  asm volatile ("prefetcht0 (%0)" : : "r" (p));
-}
+/* Samples above the threshold (interrupts, page faults) are dropped */
+#define OUTLIER_THRESHOLD 100000
+
+/* With WITH_STREAMING, samples are not stored and REPEAT is only the cap: a
+ * cell stops once the 95% confidence interval of its mean (or, with
+ * CONFIDENCE_MEDIAN, its median) is narrower than CONFIDENCE_WIDTH cycles,
+ * checked every CHECK_INTERVAL samples after MIN_REPEAT */
+#ifndef CONFIDENCE_WIDTH
+#define CONFIDENCE_WIDTH 4.0
+#endif
+#ifndef CONFIDENCE_MEDIAN
+#define CONFIDENCE_MEDIAN 0
+#endif
+#define CONFIDENCE_Z 1.96
+#define MIN_REPEAT 10000
+#define CHECK_INTERVAL 1000
+
+/* Bins up to 8192 cycles, cpuid can take several thousand */
+#define STREAMING_BINS 4096
+#include "streaming.h"
 
 char __attribute__((aligned(4096))) dummy[4096];
 
@@ -19,11 +39,15 @@ uint64_t rdtscnf1() {
     return t1.tv_sec * 1000 * 1000 * 1000ULL + t1.tv_nsec;
 }
 
+#if WITH_STREAMING == 1
+streaming_t accumulator;
+#else
 float results[REPEAT];
+#endif
 
 #define REP8(i) i i i i i i i i
 
-#define SEP printf("----------------------------------------------------\n");
+#define SEP fprintf(stderr, "----------------------------------------------------\n");
 
 void compute_statistics(float* values, size_t n, float* average, float* variance, float* std_deviation, size_t threshold, size_t* new_n)
 {
@@ -65,68 +89,200 @@ void compute_statistics(float* values, size_t n, float* average, float* variance
   }
 }
 
-volatile size_t start, end;
+/* Measurement matrix: every operation, followed by every serializer, on
+ * every cache state. Each cell is its own kernel on its own page, with the
+ * operation and serializer inlined between the two timestamps. */
+#define OPERATIONS(X) \
+  X(none) \
+  X(load) \
+  X(store) \
+  X(prefetcht0) \
+  X(prefetcht1) \
+  X(prefetcht2) \
+  X(prefetchnta) \
+  X(prefetchw) \
+  X(clflush)
+
+#define SERIALIZERS(X, operation) \
+  X(operation, none) \
+  X(operation, lfence) \
+  X(operation, mfence) \
+  X(operation, sfence) \
+  X(operation, cpuid) \
+  X(operation, rdtscp)
+
+#define CACHE_STATES(X) \
+  X(flushed) \
+  X(cached) \
+  X(tlb_cold)
+
+#define OPERATION_none(p)
+#define OPERATION_load(p)        asm volatile("movq (%0), %%rax" : : "r"(p) : "rax")
+#define OPERATION_store(p)       asm volatile("movq %%rax, (%0)" : : "r"(p) : "rax", "memory")
+#define OPERATION_prefetcht0(p)  asm volatile("prefetcht0 (%0)" : : "r"(p))
+#define OPERATION_prefetcht1(p)  asm volatile("prefetcht1 (%0)" : : "r"(p))
+#define OPERATION_prefetcht2(p)  asm volatile("prefetcht2 (%0)" : : "r"(p))
+#define OPERATION_prefetchnta(p) asm volatile("prefetchnta (%0)" : : "r"(p))
+#define OPERATION_prefetchw(p)   asm volatile("prefetchw (%0)" : : "r"(p))
+#define OPERATION_clflush(p)     asm volatile("clflush (%0)" : : "r"(p) : "memory")
+
+#define SERIALIZER_none()
+#define SERIALIZER_lfence()      asm volatile("lfence")
+#define SERIALIZER_mfence()      asm volatile("mfence")
+#define SERIALIZER_sfence()      asm volatile("sfence")
+#define SERIALIZER_cpuid()       do { unsigned int a = 0; asm volatile("cpuid" : "+a"(a) : : "rbx", "rcx", "rdx", "memory"); } while (0)
+#define SERIALIZER_rdtscp()      asm volatile("rdtscp" : : : "rax", "rcx", "rdx")
+
+typedef size_t (*kernel_t)(void*);
+
+#define KERNEL(operation, serializer) \
+  static __attribute__((noinline, aligned(4096))) size_t kernel_##operation##_##serializer(void* p) { \
+    asm volatile("lfence"); \
+    asm volatile("mfence"); \
+    size_t start = rdtsc(); \
+    OPERATION_##operation(p); \
+    SERIALIZER_##serializer(); \
+    size_t end = rdtsc(); \
+    return end - start; \
+  }
+
+#define KERNELS(operation) SERIALIZERS(KERNEL, operation)
+OPERATIONS(KERNELS)
+
+#define KERNEL_ENTRY(operation, serializer) kernel_##operation##_##serializer,
+#define KERNEL_ROW(operation) { SERIALIZERS(KERNEL_ENTRY, operation) },
+#define OPERATION_NAME(operation) #operation,
+#define SERIALIZER_NAME(operation, serializer) #serializer,
+#define CACHE_STATE_NAME(state) #state,
+#define COUNT(...) + 1
+#define COUNT_2(a, b) + 1
+
+enum { NUMBER_OF_OPERATIONS = 0 OPERATIONS(COUNT) };
+enum { NUMBER_OF_SERIALIZERS = 0 SERIALIZERS(COUNT_2, _) };
+enum { NUMBER_OF_CACHE_STATES = 0 CACHE_STATES(COUNT) };
+
+static const char* operation_names[] = { OPERATIONS(OPERATION_NAME) };
+static const char* serializer_names[] = { SERIALIZERS(SERIALIZER_NAME, _) };
+static const char* cache_state_names[] = { CACHE_STATES(CACHE_STATE_NAME) };
+static const kernel_t kernels[NUMBER_OF_OPERATIONS][NUMBER_OF_SERIALIZERS] = { OPERATIONS(KERNEL_ROW) };
+
+/* Brings the target into the cache state before each run */
+void prepare(size_t state) {
+  switch (state) {
+    case 0: /* flushed */
+      flush(dummy);
+      flush(dummy);
+      break;
+    case 1: /* cached */
+      maccess(dummy);
+      break;
+    case 2: /* tlb_cold: cached, but the permission downgrade drops its TLB entry */
+      maccess(dummy);
+      mprotect(dummy, sizeof(dummy), PROT_READ);
+      mprotect(dummy, sizeof(dummy), PROT_READ | PROT_WRITE);
+      break;
+  }
+}
+
+typedef struct measurement_s {
+  float average;
+  float median;
+  float std_deviation;
+  float width;          /* of the 95% confidence interval */
+  size_t n;
+} measurement_t;
+
+#if WITH_STREAMING == 1
+float confidence_width(const streaming_t* s) {
+#if CONFIDENCE_MEDIAN == 1
+  uint64_t low, high;
+  streaming_median_interval(s, CONFIDENCE_Z, &low, &high);
+  return (float) (high - low);
+#else
+  return 2 * CONFIDENCE_Z * streaming_standard_error(s);
+#endif
+}
+#else
+int compare_floats(const void* a, const void* b) {
+  float x = *(const float*) a, y = *(const float*) b;
+  return (x > y) - (x < y);
+}
+#endif
+
+void measure(kernel_t kernel, size_t state, measurement_t* m) {
+#if WITH_STREAMING == 1
+  streaming_init(&accumulator);
+  for (size_t i = 1; i <= REPEAT; i++) {
+    prepare(state);
+    size_t cycles = kernel(dummy);
+    if (cycles < OUTLIER_THRESHOLD) {
+      streaming_add(&accumulator, cycles);
+    }
+    if (i % CHECK_INTERVAL == 0 && accumulator.n >= MIN_REPEAT && confidence_width(&accumulator) < CONFIDENCE_WIDTH) {
+      break;
+    }
+  }
+
+  m->average = accumulator.mean;
+  m->median = streaming_quantile(&accumulator, 0.5);
+  m->std_deviation = sqrt(streaming_variance(&accumulator));
+  m->width = confidence_width(&accumulator);
+  m->n = accumulator.n;
+#else
+  for (size_t i = 0; i < REPEAT; i++) {
+    prepare(state);
+    results[i] = (float) kernel(dummy);
+  }
+
+  compute_statistics(results, REPEAT, &m->average, NULL, &m->std_deviation, OUTLIER_THRESHOLD, &m->n);
+  m->width = 2 * CONFIDENCE_Z * m->std_deviation / sqrt(m->n);
+
+  qsort(results, REPEAT, sizeof(results[0]), compare_floats);
+  m->median = results[m->n / 2];
+#endif
+}
 
 int main() {
     memset(dummy, 1, sizeof(dummy));
     printf("\n");
 
-#define MEASURE_START() \
-    asm volatile(".align 4096"); \
-    for (size_t i = 0; i < REPEAT; i++) { \
-	flush(dummy);\
-	flush(dummy);\
-        asm volatile("lfence"); \
-        asm volatile("mfence"); \
-        start = rdtsc();
-
-#define MEASURE_END(txt) \
-        end = rdtsc(); \
-        results[i] = (float) (end - start); \
-    } \
-    { \
-      float average = 0, std_deviation = 0; size_t new_n = 0; \
-      compute_statistics(results, REPEAT, &average, NULL, &std_deviation, 100000, &new_n); \
-      fprintf(stderr, "%40s: %.2f (s=%4.2f, n=%zu)\n", txt, average, std_deviation, new_n); \
+    FILE* f = fopen("matrix.csv", "w");
+    if (f == NULL) {
+      fprintf(stderr, "Error: Could not open matrix.csv\n");
+      return -1;
+    }
+    fprintf(f, "state,operation,serializer,average,median,std_deviation,n,width\n");
+
+    size_t total = 0;
+
+    for (size_t state = 0; state < NUMBER_OF_CACHE_STATES; state++) {
+        fprintf(stderr, "%s\n", cache_state_names[state]);
+        fprintf(stderr, "%12s", "");
+        for (size_t s = 0; s < NUMBER_OF_SERIALIZERS; s++) {
+            fprintf(stderr, " %10s", serializer_names[s]);
+        }
+        fprintf(stderr, "\n");
+
+        for (size_t o = 0; o < NUMBER_OF_OPERATIONS; o++) {
+            fprintf(stderr, "%12s", operation_names[o]);
+            for (size_t s = 0; s < NUMBER_OF_SERIALIZERS; s++) {
+                measurement_t m;
+                measure(kernels[o][s], state, &m);
+                total += m.n;
+                fprintf(stderr, " %10.2f", CONFIDENCE_MEDIAN ? m.median : m.average);
+                fprintf(f, "%s,%s,%s,%.2f,%.2f,%.2f,%zu,%.2f\n", cache_state_names[state], operation_names[o],
+                    serializer_names[s], m.average, m.median, m.std_deviation, m.n, m.width);
+            }
+            fprintf(stderr, "\n");
+        }
+        SEP
     }
 
-    MEASURE_START()
-        asm volatile ("CPUID\n\t" :: "a"(0), "b"(0), "c"(0), "d"(0));
-    MEASURE_END("cpuid")
-
-    MEASURE_START()
-        maccess(dummy);
-        asm volatile("nop");
-        asm volatile ("CPUID\n\t" :: "a"(0), "b"(0), "c"(0), "d"(0));
-    MEASURE_END("flush + access + cpuid")
-
-    MEASURE_START()
-        maccess(dummy);
-        asm volatile("lfence");
-    MEASURE_END("flush + access + lfence")
-
-    MEASURE_START()
-        maccess(dummy);
-        asm volatile("mfence");
-    MEASURE_END("flush + access + mfence")
-
-    SEP
-
-    MEASURE_START()
-        prefetch(dummy);
-        asm volatile("nop");
-        asm volatile ("CPUID\n\t" :: "a"(0), "b"(0), "c"(0), "d"(0));
-    MEASURE_END("flush + prefetch + cpuid")
-
-    MEASURE_START()
-        prefetch(dummy);
-        asm volatile("lfence");
-    MEASURE_END("flush + prefetch + lfence")
-
-    MEASURE_START()
-        prefetch(dummy);
-        asm volatile("mfence");
-    MEASURE_END("flush + prefetch + mfence")
+    fclose(f);
+
+    size_t cells = NUMBER_OF_CACHE_STATES * NUMBER_OF_OPERATIONS * NUMBER_OF_SERIALIZERS;
+    fprintf(stderr, "%zu samples in %zu cells (%.1f%% of %d per cell)\n", total, cells,
+        100.0 * total / ((double) cells * REPEAT), REPEAT);
 
     printf("\n");
     return 0;
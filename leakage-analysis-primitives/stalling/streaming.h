@@ -0,0 +1,107 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+/* Running statistics over a stream of timings without storing the samples.
+ *
+ * Mean and variance use Welford's update, which stays exact for values on
+ * either side of the mean. A histogram with fixed bins of
+ * STREAMING_BIN_WIDTH cycles gives quantiles and the distribution; values
+ * beyond the last bin are only counted. */
+
+#ifndef STREAMING_BINS
+#define STREAMING_BINS 512
+#endif
+#ifndef STREAMING_BIN_WIDTH
+#define STREAMING_BIN_WIDTH 2
+#endif
+
+typedef struct streaming_s {
+  size_t n;
+  double mean;
+  double m2;
+  uint64_t min;
+  uint64_t max;
+  uint32_t bins[STREAMING_BINS];
+  size_t overflow;
+} streaming_t;
+
+void streaming_init(streaming_t* s) {
+  memset(s, 0, sizeof(*s));
+  s->min = UINT64_MAX;
+}
+
+static inline void streaming_add(streaming_t* s, uint64_t value) {
+  s->n++;
+  double delta = (double) value - s->mean;
+  s->mean += delta / s->n;
+  s->m2 += delta * ((double) value - s->mean);
+
+  if (value < s->min) s->min = value;
+  if (value > s->max) s->max = value;
+
+  size_t bin = value / STREAMING_BIN_WIDTH;
+  if (bin < STREAMING_BINS) {
+    s->bins[bin]++;
+  } else {
+    s->overflow++;
+  }
+}
+
+/* Sample variance (n - 1) */
+double streaming_variance(const streaming_t* s) {
+  return s->n > 1 ? s->m2 / (s->n - 1) : 0.0;
+}
+
+double streaming_standard_error(const streaming_t* s) {
+  return s->n > 1 ? sqrt(streaming_variance(s) / s->n) : INFINITY;
+}
+
+/* Lower edge of the bin holding quantile q; max if it lies in the overflow */
+uint64_t streaming_quantile(const streaming_t* s, double q) {
+  size_t rank = (size_t) (q * s->n);
+  size_t seen = 0;
+  for (size_t i = 0; i < STREAMING_BINS; i++) {
+    seen += s->bins[i];
+    if (seen > rank) {
+      return i * STREAMING_BIN_WIDTH;
+    }
+  }
+
+  return s->max;
+}
+
+/* Distribution-free confidence interval of the median: the order statistics
+ * at ranks n/2 -/+ z * sqrt(n) / 2, widened to the bin edges */
+void streaming_median_interval(const streaming_t* s, double z, uint64_t* low, uint64_t* high) {
+  double d = s->n > 0 ? z / (2 * sqrt(s->n)) : 0.5;
+  *low = streaming_quantile(s, d < 0.5 ? 0.5 - d : 0.0);
+  *high = streaming_quantile(s, d < 0.5 ? 0.5 + d : 1.0) + STREAMING_BIN_WIDTH;
+}
+
+/* One line per non-empty bin: label,cycles,count */
+void streaming_write_histogram(const streaming_t* s, FILE* f, int label) {
+  for (size_t i = 0; i < STREAMING_BINS; i++) {
+    if (s->bins[i] != 0) {
+      fprintf(f, "%d,%zu,%u\n", label, i * STREAMING_BIN_WIDTH, s->bins[i]);
+    }
+  }
+  if (s->overflow != 0) {
+    fprintf(f, "%d,%zu,%zu\n", label, (size_t) STREAMING_BINS * STREAMING_BIN_WIDTH, s->overflow);
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
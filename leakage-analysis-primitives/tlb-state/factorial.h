@@ -0,0 +1,160 @@
+#ifndef FACTORIAL_H
+#define FACTORIAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Full or fractional factorial design over PTE bits and memory types.
+ *
+ * Every bit factor has two levels (set, cleared). With a fraction of p, only
+ * the first n - p bit factors are varied freely; each of the last p factors is
+ * the parity of a subset of at least two free factors (2^(n-p) design, main
+ * effects are not aliased with each other).
+ *
+ * Configurations are ordered by a Gray code over the free factors, reversed
+ * for every other memory type, so consecutive configurations differ in as few
+ * PTE bits as possible. */
+
+#define FACTORIAL_NAME_LENGTH 128
+
+typedef struct factorial_bit_s {
+  const char* set_name;
+  const char* unset_name;
+  size_t bit;
+} factorial_bit_t;
+
+typedef struct factorial_memory_type_s {
+  const char* name;
+  unsigned char type;
+} factorial_memory_type_t;
+
+typedef struct factorial_configuration_s {
+  size_t set;                /* PTE bits to set */
+  size_t unset;              /* PTE bits to clear */
+  size_t memory_type;        /* index into the memory types of the design */
+  char name[FACTORIAL_NAME_LENGTH];
+} factorial_configuration_t;
+
+typedef struct factorial_design_s {
+  const factorial_bit_t* bits;
+  size_t number_of_bits;
+  const factorial_memory_type_t* memory_types;
+  size_t number_of_memory_types;
+  size_t fraction;
+
+  factorial_configuration_t* configurations;
+  size_t n;
+} factorial_design_t;
+
+static void _factorial_name(factorial_design_t* design, factorial_configuration_t* configuration) {
+  size_t length = 0;
+  configuration->name[0] = '\0';
+
+  for (size_t i = 0; i < design->number_of_bits; i++) {
+    const factorial_bit_t* bit = &design->bits[i];
+    const char* name = (configuration->set & (1ull << bit->bit)) ? bit->set_name : bit->unset_name;
+    length += snprintf(configuration->name + length, FACTORIAL_NAME_LENGTH - length, "%s/", name);
+    if (length >= FACTORIAL_NAME_LENGTH) {
+      return;
+    }
+  }
+
+  if (design->number_of_memory_types > 0) {
+    snprintf(configuration->name + length, FACTORIAL_NAME_LENGTH - length, "%s",
+        design->memory_types[configuration->memory_type].name);
+  } else if (length > 0) {
+    configuration->name[length - 1] = '\0';
+  }
+}
+
+bool factorial_design_generate(factorial_design_t* design) {
+  size_t n_bits = design->number_of_bits;
+  if (design->fraction >= n_bits && n_bits > 0) {
+    return false;
+  }
+
+  size_t free_bits = n_bits - design->fraction;
+  size_t runs = 1ull << free_bits;
+  size_t blocks = design->number_of_memory_types > 0 ? design->number_of_memory_types : 1;
+
+  /* Generators of the dependent factors: distinct subsets with at least two
+   * free factors, starting from the full set */
+  size_t generators[64];
+  size_t number_of_generators = 0;
+  for (size_t mask = runs - 1; mask > 0 && number_of_generators < design->fraction; mask--) {
+    if (__builtin_popcountll(mask) >= 2) {
+      generators[number_of_generators++] = mask;
+    }
+  }
+  if (number_of_generators < design->fraction) {
+    return false;
+  }
+
+  design->n = runs * blocks;
+  design->configurations = calloc(design->n, sizeof(factorial_configuration_t));
+  if (design->configurations == NULL) {
+    return false;
+  }
+
+  size_t all = 0;
+  for (size_t i = 0; i < n_bits; i++) {
+    all |= 1ull << design->bits[i].bit;
+  }
+
+  for (size_t block = 0; block < blocks; block++) {
+    for (size_t run = 0; run < runs; run++) {
+      size_t g = (block % 2 == 0) ? run : runs - 1 - run;
+      size_t code = g ^ (g >> 1);
+
+      size_t set = 0;
+      for (size_t i = 0; i < free_bits; i++) {
+        if (code & (1ull << i)) {
+          set |= 1ull << design->bits[i].bit;
+        }
+      }
+      for (size_t j = 0; j < design->fraction; j++) {
+        if (__builtin_popcountll(code & generators[j]) % 2 == 1) {
+          set |= 1ull << design->bits[free_bits + j].bit;
+        }
+      }
+
+      factorial_configuration_t* configuration = &design->configurations[block * runs + run];
+      configuration->set = set;
+      configuration->unset = all & ~set;
+      configuration->memory_type = block;
+      _factorial_name(design, configuration);
+    }
+  }
+
+  return true;
+}
+
+/* Number of PTE bit flips plus memory type changes along the design */
+size_t factorial_design_transitions(const factorial_design_t* design) {
+  size_t transitions = 0;
+  for (size_t i = 1; i < design->n; i++) {
+    transitions += __builtin_popcountll(design->configurations[i].set ^ design->configurations[i - 1].set);
+    transitions += (design->configurations[i].memory_type != design->configurations[i - 1].memory_type);
+  }
+
+  return transitions;
+}
+
+void factorial_design_cleanup(factorial_design_t* design) {
+  free(design->configurations);
+  design->configurations = NULL;
+  design->n = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
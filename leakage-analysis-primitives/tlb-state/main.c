@@ -11,6 +11,7 @@
 #include "cacheutils.h"
 #include "performance-counter.h"
 #include "statistics.h"
+#include "factorial.h"
 #include "module/prefetch.h"
 
 #if RECORD_POWER == 1
@@ -32,6 +33,48 @@ libpowertrace_session_t session;
 #define AVG 1
 
 #define OUTLIER_THRESHOLD (5000*AVG)
+#define MI_BINS 16
+
+/* Events whose counts are constant without interference; samples in which
+ * they exceed their mode are excluded from the filtered statistics */
+static const char* interference_events[] = {
+  "ls_tablewalker.",
+  "ls_l1_d_tlb_miss.",
+  "l2_cache_req_stat.",
+};
+
+/* With WITH_KERNEL_MEASURE, each configuration is measured by a single ioctl
+ * that runs all tries in the kernel with interrupts disabled; power traces
+ * cannot be recorded there */
+#define KERNEL_MEASURE (WITH_KERNEL_MEASURE == 1 && RECORD_POWER == 0)
+
+/* Kernel-side accesses (PREFETCH_PROFILE_OP_*, PREFETCH_PROFILE_FENCE_*);
+ * the default matches the user-side prefetcht2 probe */
+#ifndef ACCESS_OPERATION
+#define ACCESS_OPERATION PREFETCH_PROFILE_OP_PREFETCHT2
+#endif
+#ifndef ACCESS_REPEAT
+#define ACCESS_REPEAT 10
+#endif
+#ifndef ACCESS_FENCE
+#define ACCESS_FENCE PREFETCH_PROFILE_FENCE_NONE
+#endif
+#if ACCESS_REPEAT > PREFETCH_PROFILE_MEASURE_MAX_REPEAT
+#error "ACCESS_REPEAT exceeds PREFETCH_PROFILE_MEASURE_MAX_REPEAT"
+#endif
+
+/* Confidence of the pairwise distinguishability report */
+#define DISTINGUISH_CONFIDENCE 0.99
+#define DISTINGUISH_FILE "distinguishability.csv"
+
+/* With WITH_DIRECT_PTE, the PTE is resolved once and modified through a user
+ * mapping of its page table; the bits are only verified every
+ * VERIFY_INTERVAL tries */
+#if WITH_DIRECT_PTE == 1
+#define VERIFY_INTERVAL 100
+#else
+#define VERIFY_INTERVAL 1
+#endif
 
 typedef struct measurement_s {
   const char* name;
@@ -42,130 +85,24 @@ typedef struct measurement_s {
 
 #define PTEDIT_MT_DEFAULT -1
 
-measurement_t measurements[] = {
-  {
-    .name = "Normal",
-    .memory_type = PTEDIT_MT_WB,
-    .set = {
-      .present = 1
-    }
-  },
-  {
-    .name = "Not-User/Not-Accessed",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .user_access = 1,
-      .accessed = 1
-    }
-  },
-  {
-    .name = "Not-Accessed",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .accessed = 1
-    }
-  },
-  {
-    .name = "Not-User",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .user_access = 1
-    }
-  },
-  {
-    .name = "Not-Present",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .present = 1
-    }
-  },
-  {
-    .name = "Not-Present/Not-User",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .present = 1,
-      .user_access = 1,
-    }
-  },
-  {
-    .name = "Not-User/Not-Dirty",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .user_access = 1,
-      .dirty = 1
-    }
-  },
-  {
-    .name = "Not-User/Not-Executable",
-    .memory_type = PTEDIT_MT_WB,
-    .set = {
-      .execution_disabled = 1
-    },
-    .unset = {
-      .user_access = 1
-    }
-  },
-  {
-    .name = "Not-User/Executable",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .execution_disabled = 1
-    },
-    .unset = {
-      .user_access = 1
-    }
-  },
-  {
-    .name = "Not-Global",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .global = 1
-    }
-  },
-  {
-    .name = "Not-Accessed",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .accessed = 1
-    }
-  },
-  {
-    .name = "Not-User/Not-Accessed",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .user_access = 1,
-      .accessed = 1
-    }
-  },
-  {
-    .name = "Not-User/Not-Accessed/Not-Present",
-    .memory_type = PTEDIT_MT_WB,
-    .unset = {
-      .user_access = 1,
-      .accessed = 1,
-      .present = 1
-    }
-  },
-  {
-    .name = "Write-Combining",
-    .memory_type = PTEDIT_MT_WC,
-  },
-  {
-    .name = "Write-Through",
-    .memory_type = PTEDIT_MT_WT,
-  },
-  {
-    .name = "Write-Protected",
-    .memory_type = PTEDIT_MT_WP,
-  },
-  {
-    .name = "Uncachable",
-    .memory_type = PTEDIT_MT_UC,
-  },
-  {
-    .name = "Uncachable Minus",
-    .memory_type = PTEDIT_MT_UCMINUS,
-  },
+/* Factors of the PTE experiment; FACTORIAL_FRACTION > 0 runs a 2^-fraction
+ * fractional design over the bits instead of the full one */
+static const factorial_bit_t factorial_bits[] = {
+  { "Present",        "Not-Present",    PTEDIT_PAGE_BIT_PRESENT },
+  { "User",           "Not-User",       PTEDIT_PAGE_BIT_USER },
+  { "Accessed",       "Not-Accessed",   PTEDIT_PAGE_BIT_ACCESSED },
+  { "Dirty",          "Not-Dirty",      PTEDIT_PAGE_BIT_DIRTY },
+  { "Global",         "Not-Global",     PTEDIT_PAGE_BIT_GLOBAL },
+  { "Not-Executable", "Executable",     PTEDIT_PAGE_BIT_NX },
+};
+
+static const factorial_memory_type_t factorial_memory_types[] = {
+  { "Write-Back",       PTEDIT_MT_WB },
+  { "Write-Through",    PTEDIT_MT_WT },
+  { "Write-Combining",  PTEDIT_MT_WC },
+  { "Write-Protected",  PTEDIT_MT_WP },
+  { "Uncachable",       PTEDIT_MT_UC },
+  { "Uncachable Minus", PTEDIT_MT_UCMINUS },
 };
 
 inline __attribute__((always_inline)) void prefetch(size_t p) {
@@ -175,16 +112,52 @@ inline __attribute__((always_inline)) void prefetch(size_t p) {
 
 char __attribute__((aligned(4096))) buffer[4096*10];
 
-void set_bits(void* address, measurement_t measurement, bool print)
+#if WITH_KERNEL_COUNTERS == 1
+static performance_counter_group_t ioctl_counter_group;
+static performance_counter_group_values_t ioctl_counter_sum;
+static size_t ioctl_counter_calls = 0;
+#endif
+
+void access_address(int pfd, size_t address)
 {
-  ptedit_entry_t entry = ptedit_resolve(address, 0);
-  entry.valid = PTEDIT_VALID_MASK_PTE;
+  prefetch_profile_access_t request = {
+    .address = address,
+    .operation = ACCESS_OPERATION,
+    .repeat = ACCESS_REPEAT,
+    .fence = ACCESS_FENCE
+  };
+
+#if WITH_KERNEL_COUNTERS == 1
+  performance_counter_group_values_t diff;
+  performance_counter_group_ioctl(&ioctl_counter_group, pfd, PREFETCH_PROFILE_IOCTL_CMD_ACCESS, (size_t) &request, &diff);
+
+  for (size_t i = 0; i < ioctl_counter_group.n; i++) {
+    ioctl_counter_sum.values[i] += diff.values[i];
+  }
+  ioctl_counter_calls++;
+#else
+  ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_ACCESS, (size_t) &request);
+#endif
+}
+
+/* Writes several page-table entries in one ioctl with a single TLB flush */
+bool update_entries(int pfd, prefetch_profile_entry_update_t* updates, size_t n)
+{
+  prefetch_profile_entry_updates_t request = {
+    .n = n,
+    .updates = updates
+  };
+
+  return (ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_UPDATE_ENTRIES, (size_t) &request) == (long) n);
+}
 
+size_t apply_bits(size_t pte, measurement_t measurement)
+{
 #define CHECK_AND_SET(x) \
   if (measurement.set.x == 1) { \
-    ptedit_cast(entry.pte, ptedit_pte_t).x = 1; \
+    ptedit_cast(pte, ptedit_pte_t).x = 1; \
   } else if (measurement.unset.x == 1) { \
-    ptedit_cast(entry.pte, ptedit_pte_t).x = 0; \
+    ptedit_cast(pte, ptedit_pte_t).x = 0; \
   }
 
   CHECK_AND_SET(present)
@@ -203,10 +176,19 @@ void set_bits(void* address, measurement_t measurement, bool print)
     if (memory_type == -1) {
       fprintf(stdout, COLOR_RED "Error: Could not find MT for %zu\n" COLOR_RESET, measurement.memory_type);
     } else {
-      entry.pte = ptedit_apply_mt(entry.pte, memory_type);
+      pte = ptedit_apply_mt(pte, memory_type);
     }
   }
 
+  return pte;
+}
+
+void set_bits(void* address, measurement_t measurement, bool print)
+{
+  ptedit_entry_t entry = ptedit_resolve(address, 0);
+  entry.valid = PTEDIT_VALID_MASK_PTE;
+  entry.pte = apply_bits(entry.pte, measurement);
+
   /* Update */
   ptedit_update(address, 0, &entry);
 
@@ -216,6 +198,61 @@ void set_bits(void* address, measurement_t measurement, bool print)
   }
 }
 
+#if WITH_DIRECT_PTE == 1
+typedef struct direct_pte_s {
+  volatile size_t* pte;
+  size_t original;
+} direct_pte_t;
+
+static direct_pte_t direct_pte;
+
+/* Maps the page table holding the PTE of address into user space */
+bool direct_pte_init(direct_pte_t* direct, void* address)
+{
+  ptedit_entry_t entry = ptedit_resolve(address, 0);
+  if ((entry.valid & PTEDIT_VALID_MASK_PTE) == 0) {
+    return false;
+  }
+
+  size_t pagesize = ptedit_get_pagesize();
+  size_t page_table = ptedit_cast(entry.pmd, ptedit_pmd_t).pfn * pagesize;
+  char* mapping = ptedit_pmap(page_table, pagesize);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  direct->pte = (volatile size_t*) mapping + (((size_t) address / pagesize) & 0x1ff);
+  direct->original = entry.pte;
+
+  return (*direct->pte == entry.pte);
+}
+
+/* Rewrites the PTE, which resets the accessed and dirty bits set by the
+ * previous try. The value is the same on every try, so an entry still in the
+ * TLB matches it and needs no invalidation. */
+static inline void direct_pte_set(direct_pte_t* direct, size_t value)
+{
+  *direct->pte = value;
+  asm volatile("mfence");
+}
+
+/* Switches to the PTE of a new configuration: one batched update with a
+ * single shootdown drops any entry cached with the previous bits */
+void direct_pte_begin(direct_pte_t* direct, int pfd, void* address, size_t value)
+{
+  prefetch_profile_entry_update_t update = {
+    .address = (size_t) address,
+    .level = PREFETCH_PROFILE_LEVEL_PTE,
+    .entry = value
+  };
+
+  if (update_entries(pfd, &update, 1) == false) {
+    direct_pte_set(direct, value);
+    ptedit_invalidate_tlb(address);
+  }
+}
+#endif
+
 bool compare_bits(void* address, measurement_t measurement)
 {
     ptedit_entry_t entry = ptedit_resolve((void*) address, 0);
@@ -248,29 +285,171 @@ bool compare_bits(void* address, measurement_t measurement)
 
 static float results[TRIES];
 static performance_counter_group_values_t results_pc[TRIES];
+static float results_column[TRIES];
+static float results_filtered[TRIES];
+static bool results_flagged[TRIES];
+/* Tries in results; in-kernel measurements skip tries whose load faulted */
+static size_t number_of_results = 0;
+static bool counter_indicates_interference[PERFORMANCE_COUNTER_MAX_COUNTERS];
+
+/* Adds the event and records whether it indicates interference */
+bool add_event(performance_counter_group_t* performance_counter_group, const char* name)
+{
+  size_t index = performance_counter_group->n;
+  if (performance_counter_group_add_event(performance_counter_group, name) == false) {
+    return false;
+  }
+
+  counter_indicates_interference[index] = false;
+  for (size_t i = 0; i < sizeof(interference_events) / sizeof(interference_events[0]); i++) {
+    if (strncmp(name, interference_events[i], strlen(interference_events[i])) == 0) {
+      counter_indicates_interference[index] = true;
+    }
+  }
+
+  return true;
+}
+
+void analyze(performance_counter_group_t* performance_counter_group)
+{
+  /* Correlation of every counter with the timing */
+  for (size_t i = 0; i < performance_counter_group->n; i++) {
+    performance_counter_group_values_column(results_pc, number_of_results, i, results_column);
+    float correlation = compute_correlation(results_column, results, number_of_results);
+    float mutual_information = compute_mutual_information(results_column, results, number_of_results, MI_BINS);
+    fprintf(stderr, "%s", COLOR_MAGENTA);
+    fprintf(stderr, "%40s - r = %+.3f, MI = %.3f bits\n", performance_counter_group->counter[i].name, correlation, mutual_information);
+    fprintf(stderr, "%s", COLOR_RESET);
+  }
+
+  /* Statistics without samples that show interference */
+  size_t number_of_flagged = performance_counter_group_flag_interference(results_pc, number_of_results, performance_counter_group->n,
+      counter_indicates_interference, results_flagged);
+  size_t n = 0;
+  for (size_t i = 0; i < number_of_results; i++) {
+    if (results_flagged[i] == false) {
+      results_filtered[n++] = results[i];
+    }
+  }
+
+  if (n > 0) {
+    float average = 0, std_deviation = 0, std_error = 0;
+    compute_statistics(results_filtered, n, NULL, &average, NULL, &std_deviation, &std_error);
+    fprintf(stderr, "%s", COLOR_BLUE);
+    fprintf(stderr, "  %6.f (sigma: %6.2f, +- %.2f, n: %8zu, interference: %zu)\n", average, std_deviation, std_error, n, number_of_flagged);
+    fprintf(stderr, "%s", COLOR_RESET);
+  }
+}
+
+#if KERNEL_MEASURE
+static uint64_t kernel_samples[TRIES];
+
+bool measure_kernel(int pfd, size_t address, measurement_t* measurement, bool flushtlb)
+{
+  prefetch_profile_measurement_t request = {
+    .address = address,
+    .operation = ACCESS_OPERATION,
+    .repeat = ACCESS_REPEAT,
+    .fence = ACCESS_FENCE,
+    .tries = TRIES,
+    .flags = flushtlb ? PREFETCH_PROFILE_MEASURE_FLUSH_TLB : 0,
+    .samples = kernel_samples
+  };
+
+  if (measurement != NULL) {
+    request.flags |= PREFETCH_PROFILE_MEASURE_UPDATE;
+    request.update.address = address;
+    request.update.level = PREFETCH_PROFILE_LEVEL_PTE;
+    request.update.entry = apply_bits(ptedit_resolve((void*) address, 0).pte, *measurement);
+    if (measurement->unset.accessed == 0) {
+      request.flags |= PREFETCH_PROFILE_MEASURE_ACCESS;
+    }
+  }
+
+  number_of_results = 0;
+  long skipped = ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_MEASURE, (size_t) &request);
+  if (skipped < 0) {
+    return false;
+  }
+
+  for (size_t i = 0; i < TRIES; i++) {
+    if (kernel_samples[i] != PREFETCH_PROFILE_SAMPLE_SKIPPED) {
+      results[number_of_results++] = (float) kernel_samples[i];
+    }
+  }
+  memset(results_pc, 0, sizeof(results_pc));
+
+  if (skipped > 0) {
+    fprintf(stderr, "Warning: %ld of %d tries skipped, the load faulted\n", skipped, TRIES);
+  }
+
+  return (number_of_results > 0);
+}
+#endif
 
 size_t measure(void* addr, measurement_t* measurement, bool flushtlb, performance_counter_group_t* performance_counter_group, bool print, size_t pfd) {
   size_t address = (size_t) addr;
   bool different = false;
-  uint64_t begin = 0, end = 0, min = 0, max = 0;
+  uint64_t min = 0, max = 0;
+
+#if WITH_KERNEL_COUNTERS == 1
+  memset(&ioctl_counter_sum, 0, sizeof(ioctl_counter_sum));
+  ioctl_counter_calls = 0;
+#endif
+
+#if WITH_DIRECT_PTE == 1
+  size_t pte = (measurement != NULL) ? apply_bits(direct_pte.original, *measurement) : 0;
+  if (measurement != NULL) {
+    direct_pte_begin(&direct_pte, pfd, addr, pte);
+  }
+#endif
+
+#if KERNEL_MEASURE
+  if (measure_kernel(pfd, address, measurement, flushtlb) == false) {
+    fprintf(stderr, "Error: In-kernel measurement failed\n");
+    return 0;
+  }
+
+  for (size_t i = 0; i < number_of_results; i++) {
+    if(results[i] < min || !min) min = results[i];
+    if(results[i] > max) max = results[i];
+  }
 
+  if (measurement != NULL) {
+    different = compare_bits((void*) address, *measurement);
+  }
+#else
+#if WITH_DIRECT_PTE == 1
+  /* Without the TLB flush and the access, the entry of the previous try must
+   * still be dropped so that the prefetch walks */
+  bool invalidate = (measurement != NULL && flushtlb == false && measurement->unset.accessed == 1);
+#endif
+  uint64_t begin = 0, end = 0;
+  number_of_results = TRIES;
   for (size_t i = 0; i < TRIES; i++) {
     if (measurement != NULL) {
+#if WITH_DIRECT_PTE == 1
+      direct_pte_set(&direct_pte, pte);
+      if (invalidate == true) {
+        ptedit_invalidate_tlb(addr);
+      }
+#else
       set_bits(addr, *measurement, false);
+#endif
       if (measurement->unset.accessed == 0) {
-        ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_ACCESS_ADDRESS, address);
+        access_address(pfd, address);
       }
     }
 
     /* Flush-TLB? */
     if (flushtlb == true) {
       ptedit_invalidate_tlb((void*) address);
-      ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_ACCESS_ADDRESS, address + 4 * 1024);
+      access_address(pfd, address + 4 * 1024);
     } else { // dont flush
       if (measurement->unset.accessed == 0) {
-        ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_ACCESS_ADDRESS, address);
+        access_address(pfd, address);
       }
-      ioctl(pfd, PREFETCH_PROFILE_IOCTL_CMD_ACCESS_ADDRESS, address + 4 * 1024);
+      access_address(pfd, address + 4 * 1024);
     }
 
     /* Read performance counter */
@@ -301,8 +480,8 @@ size_t measure(void* addr, measurement_t* measurement, bool flushtlb, performanc
     performance_counter_group_read(performance_counter_group, &pc_end);
 
     /* compare if different */
-    if (measurement != NULL) {
-      different = compare_bits((void*) address, *measurement);
+    if (measurement != NULL && i % VERIFY_INTERVAL == 0) {
+      different |= compare_bits((void*) address, *measurement);
     }
 
     performance_counter_group_values_t pc_diff = performance_counter_group_values_diff(performance_counter_group, pc_begin, pc_end);
@@ -313,26 +492,42 @@ size_t measure(void* addr, measurement_t* measurement, bool flushtlb, performanc
     if(end - begin < min || !min) min = end - begin;
     if(end - begin > max) max = end - begin;
   }
+#endif
 
   float average = 0, std_deviation = 0;
   size_t new_n = 0;
-  compute_statistics(results, TRIES, &new_n, &average, NULL, &std_deviation, NULL);
+  compute_statistics(results, number_of_results, &new_n, &average, NULL, &std_deviation, NULL);
 
   if (print == true) {
     printf("%s", flushtlb == true ? COLOR_RED : COLOR_GREEN);
     printf("  %6.f (sigma: %6.2f, min: %5zd, max: %8zd, n: %8zu)\n", average, std_deviation, min, max, new_n);
     printf("%s", COLOR_RESET);
 
+    /* The counters exclude the kernel, so they see nothing of in-kernel tries */
+#if !KERNEL_MEASURE
     for (int i = 0; i < performance_counter_group->n; i++) {
       const char* name = performance_counter_group->counter[i].name;
 
       float average = 0, std_error = 0;
-      performance_counter_group_compute_statistics(results_pc, TRIES, i, NULL, &average, NULL, NULL, &std_error);
+      performance_counter_group_compute_statistics(results_pc, number_of_results, i, NULL, &average, NULL, NULL, &std_error);
       fprintf(stderr, "%s", COLOR_MAGENTA);
       fprintf(stderr, "%40s - %.2f (+- %.2f)\n", name, average, std_error);
       fprintf(stderr, "%s", COLOR_RESET);
     }
 
+    analyze(performance_counter_group);
+#endif
+
+#if WITH_KERNEL_COUNTERS == 1
+    for (size_t i = 0; i < ioctl_counter_group.n && ioctl_counter_calls > 0; i++) {
+      fprintf(stderr, "%s", COLOR_YELLOW);
+      fprintf(stderr, "%40s - %.2f per ioctl (%s)\n", ioctl_counter_group.counter[i].name,
+          (float) ioctl_counter_sum.values[i] / ioctl_counter_calls,
+          performance_counter_privilege_name(ioctl_counter_group.counter[i].privilege));
+      fprintf(stderr, "%s", COLOR_RESET);
+    }
+#endif
+
     if (different == true) {
       printf("%s", COLOR_YELLOW);
       printf("     PTE different");
@@ -349,7 +544,7 @@ int main(int argc, char* argv[])
 {
 #if RECORD_POWER == 1
   if (argc < 2) {
-    fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <file> [<event>...]\n", argv[0]);
     return -1;
   }
 #endif
@@ -372,15 +567,44 @@ int main(int argc, char* argv[])
 
   /* Setup performance-counter */
   performance_counter_group_t performance_counter_group = performance_counter_group_init(getpid());
-#if WITH_AMD == 1
-  performance_counter_group_add(&performance_counter_group, PERF_RAW_EVENT(0x46,0x03), "Page Table Walks (D-Side)");
+#if RECORD_POWER == 1
+  int first_event = 2;
 #else
-  performance_counter_group_add(&performance_counter_group, PERF_RAW_EVENT(0x08,0x01), "Page Table Walks (D-Side)");
+  int first_event = 1;
 #endif
+  if (argc > first_event) {
+    for (int i = first_event; i < argc; i++) {
+      add_event(&performance_counter_group, argv[i]);
+    }
+  } else {
+    add_event(&performance_counter_group, "ls_tablewalker.dside");
+    add_event(&performance_counter_group, "l2_cache_req_stat.ic_dc_miss_in_l2");
+  }
+
+  if (performance_counter_group.n == 0) {
+    fprintf(stderr, "Error: No performance counter available on %s. Supported events:\n",
+        performance_counter_uarch_name(performance_counter_detect_uarch()));
+    performance_counter_event_list(performance_counter_detect_uarch(), stderr);
+    return -1;
+  }
 
   performance_counter_group_enable(&performance_counter_group);
   performance_counter_group_reset(&performance_counter_group);
 
+#if WITH_KERNEL_COUNTERS == 1
+  /* Setup user/kernel split counters for the ioctls */
+  ioctl_counter_group = performance_counter_group_init(getpid());
+  performance_counter_group_add_event_split(&ioctl_counter_group, "ls_tablewalker.dside");
+  performance_counter_group_add_event_split(&ioctl_counter_group, "ls_l1_d_tlb_miss.all");
+  if (ioctl_counter_group.n == 0) {
+    fprintf(stderr, "Error: Could not setup kernel counters, check /proc/sys/kernel/perf_event_paranoid\n");
+    return -1;
+  }
+
+  performance_counter_group_enable(&ioctl_counter_group);
+  performance_counter_group_reset(&ioctl_counter_group);
+#endif
+
   /* Initialize memory */
   memset(buffer, 0, 10*4096);
 
@@ -399,31 +623,116 @@ int main(int argc, char* argv[])
   ptedit_entry_t entry = ptedit_resolve(buffer, 0);
   entry.valid = PTEDIT_VALID_MASK_PTE;
 
+#if WITH_DIRECT_PTE == 1
+  if (direct_pte_init(&direct_pte, buffer) == false) {
+    fprintf(stderr, "Error: Could not map the page table of %p\n", buffer);
+    return -1;
+  }
+#endif
+
+  /* Experiment design: memory types without a PAT entry are left out */
+  factorial_memory_type_t memory_types[LENGTH(factorial_memory_types)];
+  size_t number_of_memory_types = 0;
+  for (size_t i = 0; i < LENGTH(factorial_memory_types); i++) {
+    if (ptedit_find_first_mt(factorial_memory_types[i].type) == -1) {
+      fprintf(stderr, COLOR_YELLOW "Warning: No PAT entry for %s, skipping\n" COLOR_RESET, factorial_memory_types[i].name);
+      continue;
+    }
+    memory_types[number_of_memory_types++] = factorial_memory_types[i];
+  }
+
+  factorial_design_t design = {
+    .bits = factorial_bits,
+    .number_of_bits = LENGTH(factorial_bits),
+    .memory_types = memory_types,
+    .number_of_memory_types = number_of_memory_types,
+    .fraction = FACTORIAL_FRACTION
+  };
+  if (factorial_design_generate(&design) == false) {
+    fprintf(stderr, "Error: Could not generate a 2^(%zu-%d) design\n", LENGTH(factorial_bits), FACTORIAL_FRACTION);
+    return -1;
+  }
+  fprintf(stdout, COLOR_CYAN "Design: %zu configurations, %zu transitions\n" COLOR_RESET,
+      design.n, factorial_design_transitions(&design));
+
+  /* Timing distributions of all configurations and flush modes */
+  size_t number_of_distributions = 0;
+  statistics_distribution_t* distributions = calloc(design.n * 2 * number_of_measurements, sizeof(statistics_distribution_t));
+  if (distributions == NULL) {
+    fprintf(stderr, "Error: Could not allocate distributions\n");
+    return -1;
+  }
+
   /* Run measurements */
-  for (size_t i = 0; i < LENGTH(measurements); i++) {
-    measurement_t measurement = measurements[i];
+  for (size_t i = 0; i < design.n; i++) {
+    factorial_configuration_t* configuration = &design.configurations[i];
+    measurement_t measurement = {
+      .name = configuration->name,
+      .memory_type = memory_types[configuration->memory_type].type
+    };
+    ptedit_cast(measurement.set, size_t) = configuration->set;
+    ptedit_cast(measurement.unset, size_t) = configuration->unset;
     fprintf(stdout, COLOR_CYAN "Measurement: %s\n" COLOR_RESET, measurement.name);
 
-    /* Restore entry */
-    ptedit_update(buffer, 0, &entry);
-
-    /* Set bits based on measurement */
-    set_bits(buffer, measurement, false);
+    /* Restore entry and set bits based on measurement */
+    prefetch_profile_entry_update_t update = {
+      .address = (size_t) buffer,
+      .level = PREFETCH_PROFILE_LEVEL_PTE,
+      .entry = apply_bits(entry.pte, measurement)
+    };
+    if (update_entries(prefetch_fd, &update, 1) == false) {
+      fprintf(stderr, "Error: Could not update the PTE of %p\n", buffer);
+      return -1;
+    }
 
     /* Run measurement */
     for (size_t j = 0; j < number_of_measurements; j++) {
       measure(buffer, &measurement, true, &performance_counter_group, true, prefetch_fd);
+      if (statistics_distribution_init(&distributions[number_of_distributions], configuration->name, true, results, number_of_results,
+            OUTLIER_THRESHOLD) == true) {
+        number_of_distributions++;
+      } else {
+        fprintf(stderr, "Error: Too few samples below %d cycles for %s\n", OUTLIER_THRESHOLD, configuration->name);
+      }
     }
 
     for (size_t j = 0; j < number_of_measurements; j++) {
       measure(buffer, &measurement, false, &performance_counter_group, true, prefetch_fd);
+      if (statistics_distribution_init(&distributions[number_of_distributions], configuration->name, false, results, number_of_results,
+            OUTLIER_THRESHOLD) == true) {
+        number_of_distributions++;
+      } else {
+        fprintf(stderr, "Error: Too few samples below %d cycles for %s\n", OUTLIER_THRESHOLD, configuration->name);
+      }
     }
   }
 
+  /* Which configurations can be told apart, and with how many tries */
+  FILE* f = fopen(DISTINGUISH_FILE, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", DISTINGUISH_FILE);
+  }
+
+  size_t max_min_samples = 0;
+  size_t distinguishable = statistics_compare_distributions(distributions, number_of_distributions,
+      DISTINGUISH_CONFIDENCE, f, &max_min_samples);
+  size_t pairs = number_of_distributions * (number_of_distributions - 1) / 2;
+  fprintf(stdout, COLOR_CYAN "Distinguishable: %zu of %zu pairs at %.0f%% confidence, up to %zu tries needed (%s)\n" COLOR_RESET,
+      distinguishable, pairs, DISTINGUISH_CONFIDENCE * 100, max_min_samples, DISTINGUISH_FILE);
+
+  if (f != NULL) {
+    fclose(f);
+  }
+  for (size_t i = 0; i < number_of_distributions; i++) {
+    statistics_distribution_cleanup(&distributions[i]);
+  }
+  free(distributions);
+
   /* Restore entry */
   ptedit_update(buffer, 0, &entry);
 
   /* Clean-up */
+  factorial_design_cleanup(&design);
   ptedit_cleanup();
 
 #if RECORD_POWER == 1
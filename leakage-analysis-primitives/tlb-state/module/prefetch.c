@@ -1,8 +1,10 @@
 /* See LICENSE file for license and copyright information */
 
+#include <asm/msr.h>
 #include <asm/tlbflush.h>
 #include <asm/uaccess.h>
 #include <drm/drm_cache.h>
+#include <linux/capability.h>
 #include <linux/cpu.h>
 #include <linux/fs.h>
 #include <linux/kallsyms.h>
@@ -13,6 +15,8 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
 #include <linux/smp.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
@@ -26,8 +30,72 @@ MODULE_LICENSE("GPL");
 
 #define BUFFER_SIZE (4096*256)
 
-inline __attribute__((always_inline)) void myprefetch(size_t p) {
-  asm volatile ("prefetcht0 (%0)" : : "r" (p));
+/* Entries written, or tries measured, between chances to reschedule */
+#define PREFETCH_PROFILE_RESCHEDULE_INTERVAL 256
+
+#define ACCESS_LOOP(instruction, address, repeat, fence) \
+  for (i = 0; i < (repeat); i++) { \
+    asm volatile (instruction " (%0)" : : "r" (address) : "memory"); \
+    if ((fence) == PREFETCH_PROFILE_FENCE_LFENCE) { \
+      asm volatile ("lfence"); \
+    } else if ((fence) == PREFETCH_PROFILE_FENCE_MFENCE) { \
+      asm volatile ("mfence"); \
+    } \
+  }
+
+/* Dispatches once, so that the loop itself contains only the access.
+ * Returns -EFAULT if a load faults; prefetches never fault. */
+static inline __attribute__((always_inline)) int access_operation(size_t address, size_t operation, size_t repeat, size_t fence) {
+  size_t i;
+  size_t value;
+  int ret = 0;
+
+  switch (operation) {
+    case PREFETCH_PROFILE_OP_PREFETCHT0:  ACCESS_LOOP("prefetcht0", address, repeat, fence); break;
+    case PREFETCH_PROFILE_OP_PREFETCHT1:  ACCESS_LOOP("prefetcht1", address, repeat, fence); break;
+    case PREFETCH_PROFILE_OP_PREFETCHT2:  ACCESS_LOOP("prefetcht2", address, repeat, fence); break;
+    case PREFETCH_PROFILE_OP_PREFETCHNTA: ACCESS_LOOP("prefetchnta", address, repeat, fence); break;
+    case PREFETCH_PROFILE_OP_PREFETCHW:   ACCESS_LOOP("prefetchw", address, repeat, fence); break;
+    case PREFETCH_PROFILE_OP_LOAD:
+      /* The entry may be not present or a supervisor entry: load through the
+       * exception table, and with page faults disabled so that the fault
+       * handler goes straight to the fixup in atomic context */
+      pagefault_disable();
+      for (i = 0; i < repeat && ret == 0; i++) {
+        ret = __get_user(value, (size_t __user*) address);
+        if (fence == PREFETCH_PROFILE_FENCE_LFENCE) {
+          asm volatile ("lfence");
+        } else if (fence == PREFETCH_PROFILE_FENCE_MFENCE) {
+          asm volatile ("mfence");
+        }
+      }
+      pagefault_enable();
+      /* __get_user clears AC again */
+      asm volatile("stac");
+      break;
+    case PREFETCH_PROFILE_OP_NONE:
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+/* Loads are made by the kernel, so outside of user space, e.g. on MMIO, they
+ * need CAP_SYS_ADMIN like entry updates; prefetches have no side effects */
+static bool operation_allowed(size_t operation, size_t address, size_t length) {
+  if (operation != PREFETCH_PROFILE_OP_LOAD) {
+    return true;
+  }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0)
+  if (access_ok((void __user*) address, length)) {
+#else
+  if (access_ok(VERIFY_READ, (void __user*) address, length)) {
+#endif
+    return true;
+  }
+
+  return capable(CAP_SYS_ADMIN);
 }
 
 static int device_open(struct inode *inode, struct file *file) {
@@ -39,15 +107,282 @@ static int device_release(struct inode *inode, struct file *file) {
 }
 
 static long access_address(unsigned long virtual_address) {
-  size_t i = 0;
   asm volatile("stac");
+  access_operation(virtual_address, PREFETCH_PROFILE_OP_PREFETCHT0, 10000, PREFETCH_PROFILE_FENCE_NONE);
+  asm volatile("clac");
+  return 0;
+}
 
-  for (i = 0; i < 10000; i++) {
-    myprefetch(virtual_address);
+static long access_address_ext(unsigned long ioctl_param) {
+  prefetch_profile_access_t request;
+  int ret;
+
+  if (copy_from_user(&request, (void __user*) ioctl_param, sizeof(request)) != 0) {
+    return -EFAULT;
+  }
+  if (request.operation > PREFETCH_PROFILE_OP_NONE || request.fence > PREFETCH_PROFILE_FENCE_MFENCE ||
+      request.repeat > PREFETCH_PROFILE_MEASURE_MAX_REPEAT) {
+    return -EINVAL;
+  }
+  if (operation_allowed(request.operation, request.address, sizeof(size_t)) == false) {
+    return -EPERM;
   }
 
+  asm volatile("stac");
+  ret = access_operation(request.address, request.operation, request.repeat, request.fence);
   asm volatile("clac");
-  return 0;
+
+  return ret;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 6, 0)
+#define pud_leaf pud_large
+#define pmd_leaf pmd_large
+#endif
+
+/* Writes one entry under the lock the kernel uses for that level: the split
+ * PTE and PMD locks, mm->page_table_lock above. The caller holds mmap_lock
+ * for reading and must not have interrupts disabled, as a lock holder may be
+ * waiting for this CPU to acknowledge a TLB shootdown. */
+static bool update_entry(struct mm_struct* mm, prefetch_profile_entry_update_t* update) {
+  size_t address = update->address;
+  spinlock_t* ptl;
+  pgd_t* pgd;
+  p4d_t* p4d;
+  pud_t* pud;
+  pmd_t* pmd;
+  pte_t* pte;
+
+  pgd = pgd_offset(mm, address);
+  if (update->level == PREFETCH_PROFILE_LEVEL_PGD) {
+    spin_lock(&mm->page_table_lock);
+    set_pgd(pgd, __pgd(update->entry));
+    spin_unlock(&mm->page_table_lock);
+    return true;
+  }
+  if (pgd_none(*pgd) || pgd_bad(*pgd)) {
+    return false;
+  }
+
+  p4d = p4d_offset(pgd, address);
+  if (update->level == PREFETCH_PROFILE_LEVEL_P4D) {
+    spin_lock(&mm->page_table_lock);
+    set_p4d(p4d, __p4d(update->entry));
+    spin_unlock(&mm->page_table_lock);
+    return true;
+  }
+  if (p4d_none(*p4d) || p4d_bad(*p4d)) {
+    return false;
+  }
+
+  pud = pud_offset(p4d, address);
+  if (update->level == PREFETCH_PROFILE_LEVEL_PUD) {
+    spin_lock(&mm->page_table_lock);
+    set_pud(pud, __pud(update->entry));
+    spin_unlock(&mm->page_table_lock);
+    return true;
+  }
+  if (pud_none(*pud) || pud_leaf(*pud)) {
+    return false;
+  }
+
+  pmd = pmd_offset(pud, address);
+  if (update->level == PREFETCH_PROFILE_LEVEL_PMD) {
+    ptl = pmd_lock(mm, pmd);
+    set_pmd(pmd, __pmd(update->entry));
+    spin_unlock(ptl);
+    return true;
+  }
+  if (pmd_none(*pmd) || pmd_leaf(*pmd)) {
+    return false;
+  }
+
+  if (update->level == PREFETCH_PROFILE_LEVEL_PTE) {
+    pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+    if (pte == NULL) {
+      return false;
+    }
+    set_pte(pte, __pte(update->entry));
+    pte_unmap_unlock(pte, ptl);
+    return true;
+  }
+
+  return false;
+}
+
+static void flush_tlb_local(void* unused) {
+  /* Drops all entries, including global ones and those of other PCIDs */
+  __flush_tlb_all();
+}
+
+static long update_entries(unsigned long ioctl_param) {
+  prefetch_profile_entry_updates_t request;
+  prefetch_profile_entry_update_t* updates;
+  struct mm_struct* mm = current->mm;
+  long written = 0;
+  size_t i;
+
+  /* Raw entries give access to any physical memory */
+  if (capable(CAP_SYS_ADMIN) == false) {
+    return -EPERM;
+  }
+  if (copy_from_user(&request, (void __user*) ioctl_param, sizeof(request)) != 0) {
+    return -EFAULT;
+  }
+  if (request.n > PREFETCH_PROFILE_MAX_UPDATES) {
+    return -EINVAL;
+  }
+
+  /* Copied before taking mmap_lock, which a fault on the array would take
+   * again */
+  updates = kvmalloc_array(request.n, sizeof(*updates), GFP_KERNEL);
+  if (updates == NULL) {
+    return -ENOMEM;
+  }
+  if (copy_from_user(updates, (void __user*) request.updates, request.n * sizeof(*updates)) != 0) {
+    kvfree(updates);
+    return -EFAULT;
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+  mmap_read_lock(mm);
+#else
+  down_read(&mm->mmap_sem);
+#endif
+
+  for (i = 0; i < request.n; i++) {
+    if (update_entry(mm, &updates[i]) == true) {
+      written++;
+    }
+    if (i % PREFETCH_PROFILE_RESCHEDULE_INTERVAL == PREFETCH_PROFILE_RESCHEDULE_INTERVAL - 1) {
+      cond_resched();
+    }
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+  mmap_read_unlock(mm);
+#else
+  up_read(&mm->mmap_sem);
+#endif
+
+  kvfree(updates);
+
+  /* Single shootdown for the whole batch */
+  on_each_cpu(flush_tlb_local, NULL, 1);
+
+  return written;
+}
+
+static inline __attribute__((always_inline)) void invalidate_tlb(size_t address) {
+  /* Only the kernel PCID: the measured accesses are made from the kernel */
+  asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+}
+
+static long measure(unsigned long ioctl_param) {
+  prefetch_profile_measurement_t request;
+  struct mm_struct* mm = current->mm;
+  unsigned long irq_flags;
+  uint64_t* samples;
+  uint64_t begin, end;
+  long ret = 0;
+  long skipped = 0;
+  bool faulted;
+  size_t i;
+
+  if (copy_from_user(&request, (void __user*) ioctl_param, sizeof(request)) != 0) {
+    return -EFAULT;
+  }
+  if (request.tries == 0 || request.tries > PREFETCH_PROFILE_MEASURE_MAX_TRIES ||
+      request.repeat > PREFETCH_PROFILE_MEASURE_MAX_REPEAT ||
+      request.operation > PREFETCH_PROFILE_OP_NONE || request.fence > PREFETCH_PROFILE_FENCE_MFENCE) {
+    return -EINVAL;
+  }
+  if ((request.flags & PREFETCH_PROFILE_MEASURE_UPDATE) && capable(CAP_SYS_ADMIN) == false) {
+    return -EPERM;
+  }
+  /* Covers address and address + 4096 */
+  if (operation_allowed(request.operation, request.address, 4096 + sizeof(size_t)) == false) {
+    return -EPERM;
+  }
+
+  samples = kvmalloc_array(request.tries, sizeof(uint64_t), GFP_KERNEL);
+  if (samples == NULL) {
+    return -ENOMEM;
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+  mmap_read_lock(mm);
+#else
+  down_read(&mm->mmap_sem);
+#endif
+
+  for (i = 0; i < request.tries; i++) {
+    preempt_disable();
+
+    /* Written with interrupts enabled, see update_entry */
+    if (request.flags & PREFETCH_PROFILE_MEASURE_UPDATE) {
+      update_entry(mm, &request.update);
+    }
+
+    local_irq_save(irq_flags);
+    asm volatile("stac");
+    faulted = false;
+
+    if (request.flags & PREFETCH_PROFILE_MEASURE_UPDATE) {
+      invalidate_tlb(request.address);
+    }
+    if (request.flags & PREFETCH_PROFILE_MEASURE_ACCESS) {
+      faulted |= (access_operation(request.address, request.operation, request.repeat, request.fence) != 0);
+    }
+    if (request.flags & PREFETCH_PROFILE_MEASURE_FLUSH_TLB) {
+      invalidate_tlb(request.address);
+    } else if (request.flags & PREFETCH_PROFILE_MEASURE_ACCESS) {
+      faulted |= (access_operation(request.address, request.operation, request.repeat, request.fence) != 0);
+    }
+    faulted |= (access_operation(request.address + 4096, request.operation, request.repeat, request.fence) != 0);
+
+    begin = rdtsc_ordered();
+    asm volatile ("prefetcht2 (%0)" : : "r" (request.address));
+    asm volatile("lfence");
+    end = rdtsc_ordered();
+
+    asm volatile("clac");
+    local_irq_restore(irq_flags);
+    preempt_enable();
+
+    if (faulted == true) {
+      samples[i] = PREFETCH_PROFILE_SAMPLE_SKIPPED;
+      skipped++;
+    } else {
+      samples[i] = end - begin;
+    }
+
+    if (i % PREFETCH_PROFILE_RESCHEDULE_INTERVAL == PREFETCH_PROFILE_RESCHEDULE_INTERVAL - 1) {
+      if (fatal_signal_pending(current)) {
+        ret = -EINTR;
+        break;
+      }
+      cond_resched();
+    }
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+  mmap_read_unlock(mm);
+#else
+  up_read(&mm->mmap_sem);
+#endif
+
+  /* An interrupted measurement returns no samples */
+  if (ret == 0) {
+    if (copy_to_user((void __user*) request.samples, samples, request.tries * sizeof(uint64_t)) != 0) {
+      ret = -EFAULT;
+    } else {
+      ret = skipped;
+    }
+  }
+  kvfree(samples);
+
+  return ret;
 }
 
 static long device_ioctl(struct file *file, unsigned int ioctl_num,
@@ -58,6 +393,12 @@ static long device_ioctl(struct file *file, unsigned int ioctl_num,
         access_address(ioctl_param);
         return 0;
       }
+    case PREFETCH_PROFILE_IOCTL_CMD_UPDATE_ENTRIES:
+      return update_entries(ioctl_param);
+    case PREFETCH_PROFILE_IOCTL_CMD_MEASURE:
+      return measure(ioctl_param);
+    case PREFETCH_PROFILE_IOCTL_CMD_ACCESS:
+      return access_address_ext(ioctl_param);
     default:
       return -1;
   }
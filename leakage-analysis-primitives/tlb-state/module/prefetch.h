@@ -9,5 +9,96 @@
 #define PREFETCH_PROFILE_IOCTL_MAGIC_NUMBER (long) 'x'
 
 #define PREFETCH_PROFILE_IOCTL_CMD_ACCESS_ADDRESS _IOR(PREFETCH_PROFILE_IOCTL_MAGIC_NUMBER, 1, size_t)
+#define PREFETCH_PROFILE_IOCTL_CMD_UPDATE_ENTRIES _IOR(PREFETCH_PROFILE_IOCTL_MAGIC_NUMBER, 2, size_t)
+#define PREFETCH_PROFILE_IOCTL_CMD_MEASURE _IOR(PREFETCH_PROFILE_IOCTL_MAGIC_NUMBER, 3, size_t)
+#define PREFETCH_PROFILE_IOCTL_CMD_ACCESS _IOR(PREFETCH_PROFILE_IOCTL_MAGIC_NUMBER, 4, size_t)
+
+/* Instruction used for kernel-side accesses */
+#define PREFETCH_PROFILE_OP_PREFETCHT0  0
+#define PREFETCH_PROFILE_OP_PREFETCHT1  1
+#define PREFETCH_PROFILE_OP_PREFETCHT2  2
+#define PREFETCH_PROFILE_OP_PREFETCHNTA 3
+#define PREFETCH_PROFILE_OP_PREFETCHW   4
+#define PREFETCH_PROFILE_OP_LOAD        5
+#define PREFETCH_PROFILE_OP_NONE        6
+
+/* Fence after every access */
+#define PREFETCH_PROFILE_FENCE_NONE   0
+#define PREFETCH_PROFILE_FENCE_LFENCE 1
+#define PREFETCH_PROFILE_FENCE_MFENCE 2
+
+/* Access: repeat times operation on address, each followed by fence. A
+ * faulting load stops the access and makes the ioctl return -EFAULT. Loads
+ * from outside of user space require CAP_SYS_ADMIN, also for measurements.
+ * PREFETCH_PROFILE_IOCTL_CMD_ACCESS_ADDRESS is prefetcht0 x 10000 without
+ * fences. */
+typedef struct prefetch_profile_access_s {
+  size_t address;
+  size_t operation;
+  size_t repeat;
+  size_t fence;
+} prefetch_profile_access_t;
+
+/* Paging levels of an entry update; P4D equals PGD with 4-level paging */
+#define PREFETCH_PROFILE_LEVEL_PGD 0
+#define PREFETCH_PROFILE_LEVEL_P4D 1
+#define PREFETCH_PROFILE_LEVEL_PUD 2
+#define PREFETCH_PROFILE_LEVEL_PMD 3
+#define PREFETCH_PROFILE_LEVEL_PTE 4
+
+typedef struct prefetch_profile_entry_update_s {
+  size_t address;
+  size_t level;
+  size_t entry;
+} prefetch_profile_entry_update_t;
+
+/* Writes all entries of the calling process in one kernel entry and flushes
+ * the TLBs once at the end. The ioctl returns the number of entries that were
+ * written; entries whose upper levels are not present are skipped. Requires
+ * CAP_SYS_ADMIN, like PREFETCH_PROFILE_MEASURE_UPDATE. */
+typedef struct prefetch_profile_entry_updates_s {
+  size_t n;
+  prefetch_profile_entry_update_t* updates;
+} prefetch_profile_entry_updates_t;
+
+#define PREFETCH_PROFILE_MAX_UPDATES (1 << 16)
+
+/* Batched measurement: every try runs the sequence below in the kernel with
+ * preemption and interrupts disabled and stores the rdtsc-timed duration of
+ * one prefetcht2 of address in samples[try]:
+ *
+ *   PREFETCH_PROFILE_MEASURE_UPDATE:    write update (interrupts still
+ *                                       enabled), invlpg address
+ *   PREFETCH_PROFILE_MEASURE_ACCESS:    access address
+ *   PREFETCH_PROFILE_MEASURE_FLUSH_TLB: invlpg address
+ *   otherwise, with _ACCESS:            access address
+ *   always:                             access address + 4096
+ *
+ * Accesses use operation, repeat and fence as in prefetch_profile_access_t.
+ * If a load faults, e.g. on a not-present entry, the try is skipped: its
+ * sample is PREFETCH_PROFILE_SAMPLE_SKIPPED and the ioctl returns the number
+ * of skipped tries. A fatal signal stops the measurement with -EINTR.
+ */
+#define PREFETCH_PROFILE_MEASURE_UPDATE    (1 << 0)
+#define PREFETCH_PROFILE_MEASURE_ACCESS    (1 << 1)
+#define PREFETCH_PROFILE_MEASURE_FLUSH_TLB (1 << 2)
+
+#define PREFETCH_PROFILE_MEASURE_MAX_TRIES (1 << 20)
+#define PREFETCH_PROFILE_SAMPLE_SKIPPED    ((uint64_t) -1)
+
+/* Bounds the time a try spends with interrupts disabled; also applies to
+ * PREFETCH_PROFILE_IOCTL_CMD_ACCESS */
+#define PREFETCH_PROFILE_MEASURE_MAX_REPEAT (1 << 16)
+
+typedef struct prefetch_profile_measurement_s {
+  size_t address;
+  size_t operation;
+  size_t repeat;
+  size_t fence;
+  size_t tries;
+  size_t flags;
+  prefetch_profile_entry_update_t update;
+  uint64_t* samples;
+} prefetch_profile_measurement_t;
 
 #endif // PREFETCH_PROFILE_MODULE_H
@@ -16,6 +16,13 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+#include <elf.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+
+#include "performance-counter-events.h"
 
 #define PERF_RAW_EVENT(sel, umask) \
   ((sel) | (((umask) << 8)))
@@ -76,10 +83,30 @@ size_t performance_counter_read(int fd) {
 
 #define PERFORMANCE_COUNTER_MAX_COUNTERS 16
 
+/* Privilege levels a counter counts in. Counting kernel events requires
+ * perf_event_paranoid <= 1 or CAP_PERFMON. */
+typedef enum performance_counter_privilege_e {
+  PERFORMANCE_COUNTER_PRIVILEGE_USER = 1,
+  PERFORMANCE_COUNTER_PRIVILEGE_KERNEL = 2,
+  PERFORMANCE_COUNTER_PRIVILEGE_ALL = 3,
+} performance_counter_privilege_t;
+
+const char* performance_counter_privilege_name(performance_counter_privilege_t privilege) {
+  switch (privilege) {
+    case PERFORMANCE_COUNTER_PRIVILEGE_USER:
+      return "user";
+    case PERFORMANCE_COUNTER_PRIVILEGE_KERNEL:
+      return "kernel";
+    default:
+      return "user+kernel";
+  }
+}
+
 typedef struct performance_counter_group_counter_s {
   int fd;
   uint64_t id;
   const char* name;
+  performance_counter_privilege_t privilege;
 } performance_counter_group_counter_t;
 
 typedef struct performance_counter_group_s {
@@ -98,8 +125,10 @@ performance_counter_group_t performance_counter_group_init(size_t pid) {
   return group;
 }
 
-bool performance_counter_group_add(performance_counter_group_t* group, size_t config, const char* name) {
-    if (group->n - 1 == PERFORMANCE_COUNTER_MAX_COUNTERS) {
+bool performance_counter_group_add_privilege(performance_counter_group_t* group, size_t config, const char* name,
+    performance_counter_privilege_t privilege) {
+    if (group->n >= PERFORMANCE_COUNTER_MAX_COUNTERS) {
+      fprintf(stderr, "[*] Group is full (%d counters)\n", PERFORMANCE_COUNTER_MAX_COUNTERS);
       return false;
     }
 
@@ -109,7 +138,8 @@ bool performance_counter_group_add(performance_counter_group_t* group, size_t co
     pe_attr.type = PERF_TYPE_RAW;
     pe_attr.size = sizeof(pe_attr);
     pe_attr.config = config;
-    pe_attr.exclude_kernel = 1;
+    pe_attr.exclude_user = !(privilege & PERFORMANCE_COUNTER_PRIVILEGE_USER);
+    pe_attr.exclude_kernel = !(privilege & PERFORMANCE_COUNTER_PRIVILEGE_KERNEL);
     pe_attr.exclude_hv = 1;
     pe_attr.exclude_callchain_kernel = 1;
     pe_attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
@@ -123,6 +153,7 @@ bool performance_counter_group_add(performance_counter_group_t* group, size_t co
 
     group->counter[group->n].fd = fd;
     group->counter[group->n].name = name;
+    group->counter[group->n].privilege = privilege;
 
     if (group->n == 0) {
       group->fd = fd;
@@ -136,6 +167,63 @@ bool performance_counter_group_add(performance_counter_group_t* group, size_t co
     return true;
 }
 
+bool performance_counter_group_add(performance_counter_group_t* group, size_t config, const char* name) {
+  return performance_counter_group_add_privilege(group, config, name, PERFORMANCE_COUNTER_PRIVILEGE_USER);
+}
+
+bool performance_counter_group_add_event_privilege(performance_counter_group_t* group, const char* event_name,
+    performance_counter_privilege_t privilege) {
+  static performance_counter_uarch_t uarch = PERFORMANCE_COUNTER_UARCH_UNKNOWN;
+  if (uarch == PERFORMANCE_COUNTER_UARCH_UNKNOWN) {
+    uarch = performance_counter_detect_uarch();
+  }
+
+  const performance_counter_event_t* event = performance_counter_event_find(uarch, event_name);
+  if (event == NULL) {
+    fprintf(stderr, "[*] Event %s is not available on %s\n", event_name, performance_counter_uarch_name(uarch));
+    return false;
+  }
+
+  return performance_counter_group_add_privilege(group, PERF_RAW_EVENT(event->event_select, event->umask),
+      event->description, privilege);
+}
+
+bool performance_counter_group_add_event(performance_counter_group_t* group, const char* event_name) {
+  return performance_counter_group_add_event_privilege(group, event_name, PERFORMANCE_COUNTER_PRIVILEGE_USER);
+}
+
+/* Removes the last counter of the group */
+void performance_counter_group_remove_last(performance_counter_group_t* group) {
+  if (group->n == 0) {
+    return;
+  }
+
+  group->n--;
+  close(group->counter[group->n].fd);
+  if (group->n == 0) {
+    group->fd = -1;
+  }
+}
+
+/* Adds the event twice, once counting in user mode and once in kernel mode,
+ * so that deltas can be attributed to either side of a syscall. Either both
+ * halves are added, adjacent, or neither. */
+bool performance_counter_group_add_event_split(performance_counter_group_t* group, const char* event_name) {
+  if (group->n + 2 > PERFORMANCE_COUNTER_MAX_COUNTERS) {
+    fprintf(stderr, "[*] Group is full (%d counters)\n", PERFORMANCE_COUNTER_MAX_COUNTERS);
+    return false;
+  }
+  if (performance_counter_group_add_event_privilege(group, event_name, PERFORMANCE_COUNTER_PRIVILEGE_USER) == false) {
+    return false;
+  }
+  if (performance_counter_group_add_event_privilege(group, event_name, PERFORMANCE_COUNTER_PRIVILEGE_KERNEL) == false) {
+    performance_counter_group_remove_last(group);
+    return false;
+  }
+
+  return true;
+}
+
 void performance_counter_group_reset(performance_counter_group_t* group) {
   int rc = ioctl(group->fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
   assert(rc == 0);
@@ -190,6 +278,438 @@ performance_counter_group_values_t performance_counter_group_values_diff(perform
   return diff;
 }
 
+/* Issues an ioctl bracketed by counter reads; diff receives the deltas of
+ * every counter (split into user and kernel by their privilege filter) */
+int performance_counter_group_ioctl(performance_counter_group_t* group, int fd, unsigned long request, unsigned long arg,
+    performance_counter_group_values_t* diff) {
+  performance_counter_group_values_t begin, end;
+
+  performance_counter_group_read(group, &begin);
+  int rc = ioctl(fd, request, arg);
+  performance_counter_group_read(group, &end);
+
+  *diff = performance_counter_group_values_diff(group, begin, end);
+
+  return rc;
+}
+
+/* Sampling mode
+ *
+ * Samples IP, time and CPU into an mmap'd perf ring buffer. User code places
+ * markers (performance_sampler_mark) at the beginning of each phase of a
+ * measurement loop; samples are attributed to the phase whose marker
+ * precedes them. Samples and markers share CLOCK_MONOTONIC as time base. */
+
+#define PERFORMANCE_SAMPLER_MAX_PHASES 16
+#define PERFORMANCE_SAMPLER_DATA_PAGES 64
+
+typedef struct performance_sampler_sample_s {
+  uint64_t ip;
+  uint64_t time;
+  uint32_t cpu;
+} performance_sampler_sample_t;
+
+typedef struct performance_sampler_marker_s {
+  uint64_t time;
+  size_t phase;
+} performance_sampler_marker_t;
+
+typedef struct performance_sampler_symbol_s {
+  uint64_t address;
+  uint64_t size;
+  const char* name;
+} performance_sampler_symbol_t;
+
+typedef struct performance_sampler_s {
+  int fd;
+  struct perf_event_mmap_page* header;
+  char* data;
+  size_t data_size;
+  size_t mmap_size;
+  size_t lost;
+
+  performance_sampler_sample_t* samples;
+  size_t n_samples;
+  size_t samples_capacity;
+
+  performance_sampler_marker_t* markers;
+  size_t n_markers;
+  size_t markers_capacity;
+
+  const char* phases[PERFORMANCE_SAMPLER_MAX_PHASES];
+  size_t n_phases;
+
+  performance_counter_privilege_t privilege;
+} performance_sampler_t;
+
+/* Samples the privilege levels in privilege; if perf_event_paranoid forbids
+ * kernel samples, falls back to user space only (see sampler->privilege) */
+bool performance_sampler_init(performance_sampler_t* sampler, pid_t pid, uint32_t type, uint64_t config, uint64_t period,
+    performance_counter_privilege_t privilege) {
+  memset(sampler, 0, sizeof(performance_sampler_t));
+  sampler->fd = -1;
+  sampler->privilege = privilege;
+
+  struct perf_event_attr pe_attr;
+  memset(&pe_attr, 0, sizeof(struct perf_event_attr));
+
+  pe_attr.type = type;
+  pe_attr.size = sizeof(pe_attr);
+  pe_attr.config = config;
+  pe_attr.sample_period = period;
+  pe_attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU;
+  pe_attr.disabled = 1;
+  pe_attr.exclude_user = !(privilege & PERFORMANCE_COUNTER_PRIVILEGE_USER);
+  pe_attr.exclude_kernel = !(privilege & PERFORMANCE_COUNTER_PRIVILEGE_KERNEL);
+  pe_attr.exclude_hv = 1;
+  pe_attr.exclude_callchain_kernel = 1;
+  pe_attr.use_clockid = 1;
+  pe_attr.clockid = CLOCK_MONOTONIC;
+  pe_attr.wakeup_events = 1;
+
+  sampler->fd = syscall(__NR_perf_event_open, &pe_attr, pid, -1, -1, 0);
+  if (sampler->fd == -1 && (errno == EACCES || errno == EPERM) && pe_attr.exclude_kernel == 0) {
+    fprintf(stderr, "[*] Kernel sampling not permitted (perf_event_paranoid), sampling user space only\n");
+    sampler->privilege = PERFORMANCE_COUNTER_PRIVILEGE_USER;
+    pe_attr.exclude_user = 0;
+    pe_attr.exclude_kernel = 1;
+    sampler->fd = syscall(__NR_perf_event_open, &pe_attr, pid, -1, -1, 0);
+  }
+  if (sampler->fd == -1) {
+    fprintf(stderr, "[*] perf_event_open failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  sampler->data_size = PERFORMANCE_SAMPLER_DATA_PAGES * page_size;
+  sampler->mmap_size = sampler->data_size + page_size;
+
+  void* m = mmap(NULL, sampler->mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, sampler->fd, 0);
+  if (m == MAP_FAILED) {
+    fprintf(stderr, "[*] Could not map perf ring buffer: %s\n", strerror(errno));
+    close(sampler->fd);
+    sampler->fd = -1;
+    return false;
+  }
+
+  sampler->header = (struct perf_event_mmap_page*) m;
+  sampler->data = (char*) m + page_size;
+
+  return true;
+}
+
+size_t performance_sampler_add_phase(performance_sampler_t* sampler, const char* name) {
+  assert(sampler->n_phases < PERFORMANCE_SAMPLER_MAX_PHASES);
+  sampler->phases[sampler->n_phases] = name;
+
+  return sampler->n_phases++;
+}
+
+void performance_sampler_enable(performance_sampler_t* sampler) {
+  int rc = ioctl(sampler->fd, PERF_EVENT_IOC_ENABLE, 0);
+  assert(rc == 0);
+}
+
+void performance_sampler_disable(performance_sampler_t* sampler) {
+  int rc = ioctl(sampler->fd, PERF_EVENT_IOC_DISABLE, 0);
+  assert(rc == 0);
+}
+
+void performance_sampler_mark(performance_sampler_t* sampler, size_t phase) {
+  if (sampler->n_markers == sampler->markers_capacity) {
+    size_t capacity = sampler->markers_capacity ? sampler->markers_capacity * 2 : 4096;
+    performance_sampler_marker_t* markers = realloc(sampler->markers, capacity * sizeof(performance_sampler_marker_t));
+    if (markers == NULL) {
+      return;
+    }
+    sampler->markers = markers;
+    sampler->markers_capacity = capacity;
+  }
+
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  performance_sampler_marker_t* marker = &sampler->markers[sampler->n_markers++];
+  marker->time = t.tv_sec * 1000*1000*1000ULL + t.tv_nsec;
+  marker->phase = phase;
+}
+
+/* Drains the ring buffer. Call it outside of the timed region often enough
+ * that the buffer does not overflow (lost samples are counted). */
+size_t performance_sampler_consume(performance_sampler_t* sampler) {
+  uint64_t head = __atomic_load_n(&sampler->header->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = sampler->header->data_tail;
+  size_t consumed = 0;
+
+  while (tail < head) {
+    char record[256];
+    struct perf_event_header* eh = (struct perf_event_header*) record;
+
+    /* Copy header and record out of the ring buffer, handling wrap-around */
+    size_t offset = tail % sampler->data_size;
+    size_t first = sampler->data_size - offset;
+    if (first >= sizeof(struct perf_event_header)) {
+      memcpy(record, sampler->data + offset, sizeof(struct perf_event_header));
+    } else {
+      memcpy(record, sampler->data + offset, first);
+      memcpy(record + first, sampler->data, sizeof(struct perf_event_header) - first);
+    }
+
+    size_t size = eh->size;
+    if (size == 0 || size > sizeof(record)) {
+      tail += size ? size : (head - tail);
+      continue;
+    }
+
+    if (first >= size) {
+      memcpy(record, sampler->data + offset, size);
+    } else {
+      memcpy(record, sampler->data + offset, first);
+      memcpy(record + first, sampler->data, size - first);
+    }
+
+    if (eh->type == PERF_RECORD_SAMPLE) {
+      uint64_t* fields = (uint64_t*) (record + sizeof(struct perf_event_header));
+
+      if (sampler->n_samples == sampler->samples_capacity) {
+        size_t capacity = sampler->samples_capacity ? sampler->samples_capacity * 2 : 4096;
+        performance_sampler_sample_t* samples = realloc(sampler->samples, capacity * sizeof(performance_sampler_sample_t));
+        if (samples != NULL) {
+          sampler->samples = samples;
+          sampler->samples_capacity = capacity;
+        }
+      }
+
+      if (sampler->n_samples < sampler->samples_capacity) {
+        performance_sampler_sample_t* sample = &sampler->samples[sampler->n_samples++];
+        sample->ip = fields[0];
+        sample->time = fields[1];
+        sample->cpu = (uint32_t) fields[2];
+        consumed++;
+      }
+    } else if (eh->type == PERF_RECORD_LOST) {
+      uint64_t* fields = (uint64_t*) (record + sizeof(struct perf_event_header));
+      sampler->lost += fields[1];
+    }
+
+    tail += size;
+  }
+
+  __atomic_store_n(&sampler->header->data_tail, tail, __ATOMIC_RELEASE);
+
+  return consumed;
+}
+
+/* Difference between link-time and run-time addresses (non-zero for PIE) */
+static uint64_t _performance_sampler_load_bias(void) {
+  Elf64_Phdr* phdr = (Elf64_Phdr*) getauxval(AT_PHDR);
+  size_t phnum = getauxval(AT_PHNUM);
+
+  for (size_t i = 0; phdr != NULL && i < phnum; i++) {
+    if (phdr[i].p_type == PT_PHDR) {
+      return (uint64_t) phdr - phdr[i].p_vaddr;
+    }
+  }
+
+  return 0;
+}
+
+static int _performance_sampler_symbol_compare(const void* a, const void* b) {
+  const performance_sampler_symbol_t* sa = a;
+  const performance_sampler_symbol_t* sb = b;
+
+  return (sa->address > sb->address) - (sa->address < sb->address);
+}
+
+/* Reads the function symbols of the running binary from its .symtab */
+static performance_sampler_symbol_t* _performance_sampler_load_symbols(size_t* n, char** strings) {
+  *n = 0;
+  *strings = NULL;
+
+  FILE* f = fopen("/proc/self/exe", "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+
+  fseek(f, 0, SEEK_END);
+  size_t length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char* image = malloc(length);
+  if (image == NULL || fread(image, 1, length, f) != length) {
+    free(image);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+
+  Elf64_Ehdr* ehdr = (Elf64_Ehdr*) image;
+  if (length < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
+    free(image);
+    return NULL;
+  }
+
+  uint64_t bias = _performance_sampler_load_bias();
+
+  Elf64_Shdr* shdr = (Elf64_Shdr*) (image + ehdr->e_shoff);
+  performance_sampler_symbol_t* symbols = NULL;
+
+  for (size_t i = 0; i < ehdr->e_shnum; i++) {
+    if (shdr[i].sh_type != SHT_SYMTAB) {
+      continue;
+    }
+
+    Elf64_Sym* syms = (Elf64_Sym*) (image + shdr[i].sh_offset);
+    size_t n_syms = shdr[i].sh_size / sizeof(Elf64_Sym);
+    Elf64_Shdr* strtab = &shdr[shdr[i].sh_link];
+
+    *strings = malloc(strtab->sh_size);
+    symbols = calloc(n_syms, sizeof(performance_sampler_symbol_t));
+    if (*strings == NULL || symbols == NULL) {
+      break;
+    }
+    memcpy(*strings, image + strtab->sh_offset, strtab->sh_size);
+
+    for (size_t s = 0; s < n_syms; s++) {
+      if (ELF64_ST_TYPE(syms[s].st_info) != STT_FUNC || syms[s].st_value == 0) {
+        continue;
+      }
+
+      symbols[*n].address = syms[s].st_value + bias;
+      symbols[*n].size = syms[s].st_size;
+      symbols[*n].name = *strings + syms[s].st_name;
+      (*n)++;
+    }
+    break;
+  }
+
+  free(image);
+
+  if (symbols != NULL) {
+    qsort(symbols, *n, sizeof(performance_sampler_symbol_t), _performance_sampler_symbol_compare);
+  }
+
+  return symbols;
+}
+
+static const char* _performance_sampler_symbolize(performance_sampler_symbol_t* symbols, size_t n, uint64_t ip) {
+  /* Kernel symbols are not loaded; canonical upper half */
+  if (ip >= 0xffff800000000000ull) {
+    return "[kernel]";
+  }
+
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (symbols[mid].address <= ip) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo > 0) {
+    performance_sampler_symbol_t* symbol = &symbols[lo - 1];
+    if (ip < symbol->address + (symbol->size ? symbol->size : 1)) {
+      return symbol->name;
+    }
+  }
+
+  return "[unknown]";
+}
+
+static size_t _performance_sampler_phase_of(performance_sampler_t* sampler, uint64_t time) {
+  size_t lo = 0, hi = sampler->n_markers;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (sampler->markers[mid].time <= time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return (lo > 0) ? sampler->markers[lo - 1].phase : sampler->n_phases;
+}
+
+void performance_sampler_report(performance_sampler_t* sampler, FILE* f) {
+  performance_sampler_consume(sampler);
+
+  size_t n_symbols = 0;
+  char* strings = NULL;
+  performance_sampler_symbol_t* symbols = _performance_sampler_load_symbols(&n_symbols, &strings);
+
+  /* Per phase (plus one slot for samples before the first marker) */
+  size_t phase_samples[PERFORMANCE_SAMPLER_MAX_PHASES + 1] = {0};
+
+  typedef struct { const char* name; size_t phase; size_t count; } entry_t;
+  entry_t* entries = calloc(sampler->n_samples + 1, sizeof(entry_t));
+  size_t n_entries = 0;
+
+  for (size_t i = 0; i < sampler->n_samples; i++) {
+    size_t phase = _performance_sampler_phase_of(sampler, sampler->samples[i].time);
+    const char* name = _performance_sampler_symbolize(symbols, n_symbols, sampler->samples[i].ip);
+    phase_samples[phase]++;
+
+    if (entries == NULL) {
+      continue;
+    }
+
+    size_t e = 0;
+    for (e = 0; e < n_entries; e++) {
+      if (entries[e].phase == phase && entries[e].name == name) {
+        entries[e].count++;
+        break;
+      }
+    }
+    if (e == n_entries) {
+      entries[n_entries].name = name;
+      entries[n_entries].phase = phase;
+      entries[n_entries].count = 1;
+      n_entries++;
+    }
+  }
+
+  size_t total = sampler->n_samples ? sampler->n_samples : 1;
+  fprintf(f, "===== Profile (%zu samples, %zu lost, %s) =====\n", sampler->n_samples, sampler->lost,
+      performance_counter_privilege_name(sampler->privilege));
+
+  for (size_t phase = 0; phase <= sampler->n_phases; phase++) {
+    if (phase_samples[phase] == 0) {
+      continue;
+    }
+
+    const char* phase_name = (phase < sampler->n_phases) ? sampler->phases[phase] : "(unmarked)";
+    fprintf(f, "%-20s %8zu (%6.2f%%)\n", phase_name, phase_samples[phase], 100.0 * phase_samples[phase] / total);
+
+    for (size_t e = 0; entries != NULL && e < n_entries; e++) {
+      if (entries[e].phase == phase) {
+        fprintf(f, "    %40s %8zu (%6.2f%%)\n", entries[e].name, entries[e].count,
+            100.0 * entries[e].count / phase_samples[phase]);
+      }
+    }
+  }
+
+  free(entries);
+  free(symbols);
+  free(strings);
+}
+
+void performance_sampler_cleanup(performance_sampler_t* sampler) {
+  if (sampler->header != NULL) {
+    munmap(sampler->header, sampler->mmap_size);
+  }
+
+  if (sampler->fd != -1) {
+    close(sampler->fd);
+  }
+
+  free(sampler->samples);
+  free(sampler->markers);
+  memset(sampler, 0, sizeof(performance_sampler_t));
+  sampler->fd = -1;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,6 +7,10 @@ extern "C" {
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "performance-counter.h"
 
 void compute_statistics(float* values, size_t n, size_t* new_n, float* average, float* variance, float* std_deviation, float* std_error)
@@ -91,6 +95,379 @@ void performance_counter_group_compute_statistics(performance_counter_group_valu
   }
 }
 
+void performance_counter_group_values_column(performance_counter_group_values_t* values, size_t n, size_t offset, float* column)
+{
+  for (size_t i = 0; i < n; i++) {
+    column[i] = (float) values[i].values[offset];
+  }
+}
+
+/* Pearson correlation coefficient */
+float compute_correlation(float* x, float* y, size_t n)
+{
+  double mean_x = 0.0, mean_y = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    mean_x += x[i];
+    mean_y += y[i];
+  }
+  mean_x /= (double) n;
+  mean_y /= (double) n;
+
+  double cov = 0.0, var_x = 0.0, var_y = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    double dx = x[i] - mean_x;
+    double dy = y[i] - mean_y;
+    cov += dx * dy;
+    var_x += dx * dx;
+    var_y += dy * dy;
+  }
+
+  if (var_x == 0.0 || var_y == 0.0) {
+    return 0.0;
+  }
+
+  return cov / sqrt(var_x * var_y);
+}
+
+static size_t _mutual_information_bin(float v, float min, float max, size_t bins)
+{
+  if (max <= min) {
+    return 0;
+  }
+
+  size_t bin = (size_t) ((v - min) / (max - min) * bins);
+  return bin >= bins ? bins - 1 : bin;
+}
+
+/* Mutual information (in bits) of x and y, estimated on a bins x bins histogram */
+float compute_mutual_information(float* x, float* y, size_t n, size_t bins)
+{
+  float min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0];
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] < min_x) min_x = x[i];
+    if (x[i] > max_x) max_x = x[i];
+    if (y[i] < min_y) min_y = y[i];
+    if (y[i] > max_y) max_y = y[i];
+  }
+
+  size_t* joint = calloc(bins * bins + 2 * bins, sizeof(size_t));
+  if (joint == NULL) {
+    return 0.0;
+  }
+  size_t* marginal_x = joint + bins * bins;
+  size_t* marginal_y = marginal_x + bins;
+
+  for (size_t i = 0; i < n; i++) {
+    size_t bx = _mutual_information_bin(x[i], min_x, max_x, bins);
+    size_t by = _mutual_information_bin(y[i], min_y, max_y, bins);
+    joint[bx * bins + by]++;
+    marginal_x[bx]++;
+    marginal_y[by]++;
+  }
+
+  double mi = 0.0;
+  for (size_t bx = 0; bx < bins; bx++) {
+    for (size_t by = 0; by < bins; by++) {
+      size_t c = joint[bx * bins + by];
+      if (c == 0) {
+        continue;
+      }
+      double p_xy = (double) c / n;
+      double p_x = (double) marginal_x[bx] / n;
+      double p_y = (double) marginal_y[by] / n;
+      mi += p_xy * log2(p_xy / (p_x * p_y));
+    }
+  }
+
+  free(joint);
+
+  return mi;
+}
+
+static int _compare_uint64(const void* a, const void* b)
+{
+  uint64_t va = *(const uint64_t*) a;
+  uint64_t vb = *(const uint64_t*) b;
+
+  return (va > vb) - (va < vb);
+}
+
+/* Most frequent value of a counter over all samples */
+uint64_t performance_counter_group_compute_mode(performance_counter_group_values_t* values, size_t n, size_t offset)
+{
+  uint64_t* sorted = malloc(n * sizeof(uint64_t));
+  if (sorted == NULL || n == 0) {
+    free(sorted);
+    return 0;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    sorted[i] = values[i].values[offset];
+  }
+  qsort(sorted, n, sizeof(uint64_t), _compare_uint64);
+
+  uint64_t mode = sorted[0];
+  size_t mode_count = 0, count = 0;
+  for (size_t i = 0; i < n; i++) {
+    count = (i > 0 && sorted[i] == sorted[i - 1]) ? count + 1 : 1;
+    if (count > mode_count) {
+      mode_count = count;
+      mode = sorted[i];
+    }
+  }
+
+  free(sorted);
+
+  return mode;
+}
+
+/* Flags samples in which any counter marked in indicators exceeds its most
+ * frequent value, e.g. additional page walks or L2 misses caused by
+ * interference. Counters that vary continuously, such as cycles, must not be
+ * marked, as half of the samples lie above their mode. Returns the number of
+ * flagged samples. */
+size_t performance_counter_group_flag_interference(performance_counter_group_values_t* values, size_t n, size_t counters,
+    const bool* indicators, bool* flagged)
+{
+  memset(flagged, 0, n * sizeof(bool));
+
+  for (size_t c = 0; c < counters; c++) {
+    if (indicators[c] == false) {
+      continue;
+    }
+    uint64_t mode = performance_counter_group_compute_mode(values, n, c);
+    for (size_t i = 0; i < n; i++) {
+      if (values[i].values[c] > mode) {
+        flagged[i] = true;
+      }
+    }
+  }
+
+  size_t number_of_flagged = 0;
+  for (size_t i = 0; i < n; i++) {
+    number_of_flagged += flagged[i];
+  }
+
+  return number_of_flagged;
+}
+
+/* Pairwise distinguishability of timing distributions
+ *
+ * Every pair of distributions is compared with Welch's t-test and the
+ * two-sample Kolmogorov-Smirnov test; the confidence is Bonferroni-corrected
+ * for the number of pairs. The KS statistic is computed on empirical CDFs
+ * over a shared grid, so each pair costs one pass over the bins. The CDFs are
+ * fixed point so that the loop vectorizes without -ffast-math. */
+
+#define STATISTICS_CDF_BINS 1024
+#define STATISTICS_CDF_SCALE (1 << 24)
+#define STATISTICS_POWER 0.8
+
+typedef struct statistics_distribution_s {
+  const char* name;
+  bool flushed;
+  size_t n;
+  double mean;
+  double variance;        /* sample variance (n - 1) */
+  float* values;
+  int32_t* cdf;           /* fixed point, STATISTICS_CDF_SCALE = 1 */
+} statistics_distribution_t;
+
+typedef struct statistics_pair_s {
+  double t;
+  double ks;
+  double effect_size;     /* Cohen's d */
+  size_t min_samples;     /* per configuration, SIZE_MAX if not distinguishable */
+  bool distinguishable;
+} statistics_pair_t;
+
+/* Quantile of the standard normal distribution */
+double statistics_normal_quantile(double p)
+{
+  double lo = -40.0, hi = 40.0;
+  for (size_t i = 0; i < 200; i++) {
+    double mid = (lo + hi) / 2;
+    if (0.5 * erfc(-mid / sqrt(2.0)) < p) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return (lo + hi) / 2;
+}
+
+void statistics_distribution_cleanup(statistics_distribution_t* distribution)
+{
+  free(distribution->values);
+  free(distribution->cdf);
+  distribution->values = NULL;
+  distribution->cdf = NULL;
+}
+
+/* Copies the values below threshold; a single interrupt would otherwise
+ * stretch the shared CDF grid over all bins and skew mean and variance */
+bool statistics_distribution_init(statistics_distribution_t* distribution, const char* name, bool flushed, float* values, size_t n,
+    float threshold)
+{
+  distribution->name = name;
+  distribution->flushed = flushed;
+  distribution->n = 0;
+  distribution->cdf = NULL;
+  distribution->values = malloc(n * sizeof(float));
+  if (distribution->values == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (values[i] < threshold) {
+      distribution->values[distribution->n++] = values[i];
+    }
+  }
+  n = distribution->n;
+  if (n < 2) {
+    statistics_distribution_cleanup(distribution);
+    return false;
+  }
+
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sum += distribution->values[i];
+  }
+  distribution->mean = sum / n;
+
+  double sum1 = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sum1 += (distribution->values[i] - distribution->mean) * (distribution->values[i] - distribution->mean);
+  }
+  distribution->variance = sum1 / (n - 1);
+
+  return true;
+}
+
+static bool _statistics_build_cdfs(statistics_distribution_t* distributions, size_t n)
+{
+  for (size_t d = 0; d < n; d++) {
+    if (distributions[d].values == NULL) {
+      return false;
+    }
+  }
+
+  float min = distributions[0].values[0], max = min;
+  for (size_t d = 0; d < n; d++) {
+    for (size_t i = 0; i < distributions[d].n; i++) {
+      float v = distributions[d].values[i];
+      if (v < min) min = v;
+      if (v > max) max = v;
+    }
+  }
+
+  for (size_t d = 0; d < n; d++) {
+    statistics_distribution_t* distribution = &distributions[d];
+    free(distribution->cdf);
+    distribution->cdf = calloc(STATISTICS_CDF_BINS, sizeof(int32_t));
+    if (distribution->cdf == NULL) {
+      return false;
+    }
+
+    for (size_t i = 0; i < distribution->n; i++) {
+      distribution->cdf[_mutual_information_bin(distribution->values[i], min, max, STATISTICS_CDF_BINS)]++;
+    }
+
+    size_t sum = 0;
+    for (size_t b = 0; b < STATISTICS_CDF_BINS; b++) {
+      sum += distribution->cdf[b];
+      distribution->cdf[b] = (int32_t) ((double) sum / distribution->n * STATISTICS_CDF_SCALE);
+    }
+  }
+
+  return true;
+}
+
+static inline double _statistics_ks(const int32_t* restrict a, const int32_t* restrict b)
+{
+  int32_t d = 0;
+  for (size_t i = 0; i < STATISTICS_CDF_BINS; i++) {
+    int32_t diff = abs(a[i] - b[i]);
+    d = diff > d ? diff : d;
+  }
+
+  return (double) d / STATISTICS_CDF_SCALE;
+}
+
+void statistics_compare_pair(statistics_distribution_t* a, statistics_distribution_t* b, double z, double z_power, double ks_c,
+    statistics_pair_t* pair)
+{
+  double se = sqrt(a->variance / a->n + b->variance / b->n);
+  double pooled = sqrt(((a->n - 1) * a->variance + (b->n - 1) * b->variance) / (a->n + b->n - 2));
+  double difference = fabs(a->mean - b->mean);
+
+  pair->t = (se > 0) ? difference / se : (difference > 0 ? INFINITY : 0);
+  pair->effect_size = (pooled > 0) ? difference / pooled : (difference > 0 ? INFINITY : 0);
+  pair->ks = _statistics_ks(a->cdf, b->cdf);
+
+  /* Welch: normal approximation of the t distribution (n is large) */
+  bool welch = pair->t > z;
+  bool ks = pair->ks > ks_c * sqrt((double) (a->n + b->n) / ((double) a->n * b->n));
+  pair->distinguishable = welch || ks;
+
+  /* Samples per configuration for a two-sided test at the given confidence and power */
+  if (pair->effect_size == 0) {
+    pair->min_samples = SIZE_MAX;
+  } else if (isinf(pair->effect_size)) {
+    pair->min_samples = 2;
+  } else {
+    double m = (z + z_power) / pair->effect_size;
+    pair->min_samples = (size_t) ceil(2 * m * m);
+  }
+}
+
+/* Compares all pairs; writes one CSV line per pair and returns the number of
+ * distinguishable pairs. *max_min_samples receives the largest minimum sample
+ * count among distinguishable pairs. */
+size_t statistics_compare_distributions(statistics_distribution_t* distributions, size_t n, float confidence, FILE* csv,
+    size_t* max_min_samples)
+{
+  size_t pairs = n * (n - 1) / 2;
+  if (pairs == 0 || _statistics_build_cdfs(distributions, n) == false) {
+    return 0;
+  }
+
+  double alpha = (1.0 - confidence) / pairs;
+  double z = statistics_normal_quantile(1.0 - alpha / 2);
+  double z_power = statistics_normal_quantile(STATISTICS_POWER);
+  double ks_c = sqrt(-0.5 * log(alpha / 2));
+
+  if (csv != NULL) {
+    fprintf(csv, "a,flush_a,b,flush_b,mean_a,mean_b,t,ks,d,min_samples,distinguishable\n");
+  }
+
+  size_t distinguishable = 0;
+  *max_min_samples = 0;
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = i + 1; j < n; j++) {
+      statistics_pair_t pair;
+      statistics_compare_pair(&distributions[i], &distributions[j], z, z_power, ks_c, &pair);
+
+      if (pair.distinguishable == true) {
+        distinguishable++;
+        if (pair.min_samples > *max_min_samples) {
+          *max_min_samples = pair.min_samples;
+        }
+      }
+
+      if (csv != NULL) {
+        fprintf(csv, "%s,%d,%s,%d,%.2f,%.2f,%.3f,%.4f,%.4f,%zd,%d\n",
+            distributions[i].name, distributions[i].flushed, distributions[j].name, distributions[j].flushed,
+            distributions[i].mean, distributions[j].mean, pair.t, pair.ks, pair.effect_size,
+            pair.min_samples == SIZE_MAX ? (ssize_t) -1 : (ssize_t) pair.min_samples, pair.distinguishable);
+      }
+    }
+  }
+
+  return distinguishable;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,778 @@
+/* See LICENSE file for license and copyright information */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <cpuid.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#define COLOR_RED     "\x1b[31m"
+#define COLOR_GREEN   "\x1b[32m"
+#define COLOR_YELLOW  "\x1b[33m"
+#define COLOR_RESET   "\x1b[0m"
+
+#define STORE_ENV "RESULTS_STORE"
+#define STORE_DEFAULT "results-store"
+#define RUNS_DIRECTORY "runs"
+#define META_FILE "meta"
+
+#define MAX_META 64
+#define MAX_FILES 32
+#define MAX_QUERIES 16
+#define MAX_COLUMNS 64
+#define ID_LENGTH 16
+
+#define LENGTH(x) (sizeof(x)/sizeof((x)[0]))
+
+/* Metadata of a run: ordered key=value pairs */
+typedef struct meta_s {
+  char keys[MAX_META][64];
+  char values[MAX_META][256];
+  size_t n;
+} meta_t;
+
+static const char* meta_get(const meta_t* meta, const char* key) {
+  for (size_t i = 0; i < meta->n; i++) {
+    if (strcmp(meta->keys[i], key) == 0) {
+      return meta->values[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void meta_set(meta_t* meta, const char* key, const char* value) {
+  size_t i = 0;
+  while (i < meta->n && strcmp(meta->keys[i], key) != 0) {
+    i++;
+  }
+  if (i == MAX_META) {
+    return;
+  }
+  if (i == meta->n) {
+    meta->n++;
+  }
+
+  snprintf(meta->keys[i], sizeof(meta->keys[i]), "%s", key);
+  snprintf(meta->values[i], sizeof(meta->values[i]), "%s", value);
+  meta->values[i][strcspn(meta->values[i], "\n")] = '\0';
+}
+
+static bool meta_read(meta_t* meta, const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+
+  meta->n = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char* value = strchr(line, '=');
+    if (line[0] == '#' || value == NULL) {
+      continue;
+    }
+    *value++ = '\0';
+    meta_set(meta, line, value);
+  }
+  fclose(f);
+
+  return true;
+}
+
+static bool meta_write(const meta_t* meta, const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    return false;
+  }
+
+  fprintf(f, "# results-store run metadata\n");
+  for (size_t i = 0; i < meta->n; i++) {
+    fprintf(f, "%s=%s\n", meta->keys[i], meta->values[i]);
+  }
+  fclose(f);
+
+  return true;
+}
+
+/* Reads the first line of a file, empty if it does not exist */
+static void read_line(const char* path, char* buffer, size_t length) {
+  buffer[0] = '\0';
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return;
+  }
+  if (fgets(buffer, length, f) == NULL) {
+    buffer[0] = '\0';
+  }
+  buffer[strcspn(buffer, "\n")] = '\0';
+  fclose(f);
+}
+
+/* Value of the first "key : value" line in /proc/cpuinfo */
+static void read_cpuinfo(const char* key, char* buffer, size_t length) {
+  buffer[0] = '\0';
+  FILE* f = fopen("/proc/cpuinfo", "r");
+  if (f == NULL) {
+    return;
+  }
+
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, key, strlen(key)) == 0 && (line[strlen(key)] == ' ' || line[strlen(key)] == '\t')) {
+      char* value = strchr(line, ':');
+      if (value != NULL) {
+        value += strspn(value + 1, " ") + 1;
+        snprintf(buffer, length, "%s", value);
+        buffer[strcspn(buffer, "\n")] = '\0';
+      }
+      break;
+    }
+  }
+  fclose(f);
+}
+
+static void capture_cpuid(meta_t* meta) {
+  unsigned int a = 0, b = 0, c = 0, d = 0;
+  char buffer[64];
+
+  char vendor[13] = {0};
+  __get_cpuid(0, &a, &b, &c, &d);
+  memcpy(vendor + 0, &b, 4);
+  memcpy(vendor + 4, &d, 4);
+  memcpy(vendor + 8, &c, 4);
+  meta_set(meta, "cpu_vendor", vendor);
+
+  __get_cpuid(1, &a, &b, &c, &d);
+  unsigned int family = (a >> 8) & 0xf;
+  unsigned int model = (a >> 4) & 0xf;
+  if (family == 0xf) {
+    family += (a >> 20) & 0xff;
+  }
+  if (family == 0x6 || family >= 0xf) {
+    model |= ((a >> 16) & 0xf) << 4;
+  }
+  snprintf(buffer, sizeof(buffer), "0x%x", family);
+  meta_set(meta, "cpu_family", buffer);
+  snprintf(buffer, sizeof(buffer), "0x%x", model);
+  meta_set(meta, "cpu_model", buffer);
+  snprintf(buffer, sizeof(buffer), "0x%x", a & 0xf);
+  meta_set(meta, "cpu_stepping", buffer);
+
+  char name[49] = {0};
+  if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+    for (unsigned int i = 0; i < 3; i++) {
+      __get_cpuid(0x80000002 + i, &a, &b, &c, &d);
+      memcpy(name + i * 16 + 0, &a, 4);
+      memcpy(name + i * 16 + 4, &b, 4);
+      memcpy(name + i * 16 + 8, &c, 4);
+      memcpy(name + i * 16 + 12, &d, 4);
+    }
+  }
+  char* trimmed = name + strspn(name, " ");
+  for (size_t i = strlen(trimmed); i > 0 && trimmed[i - 1] == ' '; i--) {
+    trimmed[i - 1] = '\0';
+  }
+  meta_set(meta, "cpu_name", trimmed);
+}
+
+/* Fills the metadata of the machine the tool runs on */
+static void capture_machine(meta_t* meta) {
+  char buffer[256];
+
+  capture_cpuid(meta);
+
+  read_cpuinfo("microcode", buffer, sizeof(buffer));
+  meta_set(meta, "microcode", buffer);
+
+  struct utsname uts;
+  if (uname(&uts) == 0) {
+    meta_set(meta, "kernel", uts.release);
+    meta_set(meta, "hostname", uts.nodename);
+  }
+
+  snprintf(buffer, sizeof(buffer), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+  meta_set(meta, "cpus", buffer);
+
+  static const struct {
+    const char* key;
+    const char* path;
+  } sysfs[] = {
+    { "governor",        "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor" },
+    { "driver",          "/sys/devices/system/cpu/cpu0/cpufreq/scaling_driver" },
+    { "frequency_min",   "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_min_freq" },
+    { "frequency_max",   "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq" },
+    { "boost",           "/sys/devices/system/cpu/cpufreq/boost" },
+    { "smt",             "/sys/devices/system/cpu/smt/control" },
+  };
+  for (size_t i = 0; i < LENGTH(sysfs); i++) {
+    read_line(sysfs[i].path, buffer, sizeof(buffer));
+    meta_set(meta, sysfs[i].key, buffer);
+  }
+}
+
+/* FNV-1a */
+static uint64_t hash_update(uint64_t hash, const void* data, size_t length) {
+  const uint8_t* p = (const uint8_t*) data;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static bool hash_file(uint64_t* hash, const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) {
+    return false;
+  }
+
+  char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    *hash = hash_update(*hash, buffer, n);
+  }
+  fclose(f);
+
+  return true;
+}
+
+static bool copy_file(const char* from, const char* to) {
+  FILE* in = fopen(from, "rb");
+  if (in == NULL) {
+    return false;
+  }
+  FILE* out = fopen(to, "wb");
+  if (out == NULL) {
+    fclose(in);
+    return false;
+  }
+
+  char buffer[65536];
+  size_t n;
+  bool ok = true;
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    ok &= (fwrite(buffer, 1, n, out) == n);
+  }
+  fclose(in);
+  ok &= (fclose(out) == 0);
+
+  return ok;
+}
+
+static bool make_directory(const char* path) {
+  char buffer[4096];
+  snprintf(buffer, sizeof(buffer), "%s", path);
+
+  for (char* p = buffer + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      if (mkdir(buffer, 0755) != 0 && errno != EEXIST) {
+        return false;
+      }
+      *p = '/';
+    }
+  }
+
+  return (mkdir(buffer, 0755) == 0 || errno == EEXIST);
+}
+
+/* Removes a run directory, which holds only plain files */
+static bool remove_directory(const char* path) {
+  DIR* dir = opendir(path);
+  if (dir == NULL) {
+    return (errno == ENOENT);
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      char file[8192];
+      snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+      unlink(file);
+    }
+  }
+  closedir(dir);
+
+  return (rmdir(path) == 0);
+}
+
+/* Resolves a unique id prefix to the directory of the run */
+static bool find_run(const char* store, const char* prefix, char* path, size_t length) {
+  char runs[2048];
+  snprintf(runs, sizeof(runs), "%s/" RUNS_DIRECTORY, store);
+
+  DIR* dir = opendir(runs);
+  if (dir == NULL) {
+    fprintf(stderr, "Error: No store at %s\n", store);
+    return false;
+  }
+
+  size_t matches = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.' && strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
+      snprintf(path, length, "%s/%s", runs, entry->d_name);
+      matches++;
+    }
+  }
+  closedir(dir);
+
+  if (matches != 1) {
+    fprintf(stderr, "Error: %s run matches '%s'\n", matches == 0 ? "No" : "More than one", prefix);
+    return false;
+  }
+
+  return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int command_add(const char* store, const meta_t* overrides, char** files, size_t n) {
+  if (n == 0) {
+    fprintf(stderr, "Error: No result files given\n");
+    return -1;
+  }
+  if (n > MAX_FILES) {
+    fprintf(stderr, "Error: At most %d files per run\n", MAX_FILES);
+    return -1;
+  }
+
+  meta_t meta = { .n = 0 };
+  capture_machine(&meta);
+  for (size_t i = 0; i < overrides->n; i++) {
+    meta_set(&meta, overrides->keys[i], overrides->values[i]);
+  }
+
+  /* Files are stored by their basename, which must be unique within a run */
+  char names[1024] = "";
+  for (size_t i = 0; i < n; i++) {
+    char copy[4096];
+    snprintf(copy, sizeof(copy), "%s", files[i]);
+    const char* name = basename(copy);
+    if (strcmp(name, META_FILE) == 0) {
+      fprintf(stderr, "Error: %s clashes with the metadata file\n", files[i]);
+      return -1;
+    }
+    for (size_t j = 0; j < i; j++) {
+      char other[4096];
+      snprintf(other, sizeof(other), "%s", files[j]);
+      if (strcmp(name, basename(other)) == 0) {
+        fprintf(stderr, "Error: %s and %s have the same name\n", files[j], files[i]);
+        return -1;
+      }
+    }
+    size_t length = strlen(names);
+    snprintf(names + length, sizeof(names) - length, "%s%s", i ? "," : "", name);
+  }
+  meta_set(&meta, "files", names);
+
+  /* The id covers the metadata and the content, but not the time of import */
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < meta.n; i++) {
+    hash = hash_update(hash, meta.keys[i], strlen(meta.keys[i]) + 1);
+    hash = hash_update(hash, meta.values[i], strlen(meta.values[i]) + 1);
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (hash_file(&hash, files[i]) == false) {
+      fprintf(stderr, "Error: Could not read %s\n", files[i]);
+      return -1;
+    }
+  }
+
+  char id[ID_LENGTH + 1];
+  snprintf(id, sizeof(id), "%016llx", (unsigned long long) hash);
+
+  char run[4096];
+  snprintf(run, sizeof(run), "%s/" RUNS_DIRECTORY "/%s", store, id);
+
+  struct stat st;
+  if (stat(run, &st) == 0) {
+    fprintf(stderr, COLOR_YELLOW "Run %s is already stored\n" COLOR_RESET, id);
+    printf("%s\n", id);
+    return 0;
+  }
+
+  /* The run is assembled in a hidden directory, which list and show skip, and
+   * only renamed into place once complete */
+  char partial[4096];
+  snprintf(partial, sizeof(partial), "%s/" RUNS_DIRECTORY "/.%s.tmp", store, id);
+  if (remove_directory(partial) == false || make_directory(partial) == false) {
+    fprintf(stderr, "Error: Could not create %s\n", partial);
+    return -1;
+  }
+
+  time_t now = time(NULL);
+  char date[64];
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+  meta_t stored = { .n = 0 };
+  meta_set(&stored, "id", id);
+  meta_set(&stored, "date", date);
+  for (size_t i = 0; i < meta.n; i++) {
+    meta_set(&stored, meta.keys[i], meta.values[i]);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    char copy[4096], target[8192];
+    snprintf(copy, sizeof(copy), "%s", files[i]);
+    snprintf(target, sizeof(target), "%s/%s", partial, basename(copy));
+    if (copy_file(files[i], target) == false) {
+      fprintf(stderr, "Error: Could not copy %s\n", files[i]);
+      remove_directory(partial);
+      return -1;
+    }
+  }
+
+  char path[8192];
+  snprintf(path, sizeof(path), "%s/" META_FILE, partial);
+  if (meta_write(&stored, path) == false) {
+    fprintf(stderr, "Error: Could not write %s\n", path);
+    remove_directory(partial);
+    return -1;
+  }
+
+  if (rename(partial, run) != 0) {
+    int error = errno;
+    remove_directory(partial);
+    /* Stored concurrently under the same id */
+    if (error == EEXIST || error == ENOTEMPTY) {
+      fprintf(stderr, COLOR_YELLOW "Run %s is already stored\n" COLOR_RESET, id);
+      printf("%s\n", id);
+      return 0;
+    }
+    fprintf(stderr, "Error: Could not move %s to %s\n", partial, run);
+    return -1;
+  }
+
+  fprintf(stderr, COLOR_GREEN "Stored run %s (%s, microcode %s)\n" COLOR_RESET, id,
+      meta_get(&stored, "cpu_name"), meta_get(&stored, "microcode"));
+  printf("%s\n", id);
+
+  return 0;
+}
+
+static bool matches(const meta_t* meta, const meta_t* queries) {
+  for (size_t i = 0; i < queries->n; i++) {
+    const char* value = meta_get(meta, queries->keys[i]);
+    if (value == NULL || strstr(value, queries->values[i]) == NULL) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static int command_list(const char* store, const meta_t* queries) {
+  char runs[4096];
+  snprintf(runs, sizeof(runs), "%s/" RUNS_DIRECTORY, store);
+
+  DIR* dir = opendir(runs);
+  if (dir == NULL) {
+    fprintf(stderr, "Error: No store at %s\n", store);
+    return -1;
+  }
+
+  printf("%-16s  %-24s  %-16s  %-36s  %-10s  %-20s  %s\n", "id", "date", "tool", "cpu", "microcode", "kernel", "governor");
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    char path[8192];
+    meta_t meta;
+    snprintf(path, sizeof(path), "%s/%s/" META_FILE, runs, entry->d_name);
+    if (meta_read(&meta, path) == false || matches(&meta, queries) == false) {
+      continue;
+    }
+
+    const char* fields[] = { "id", "date", "tool", "cpu_name", "microcode", "kernel", "governor" };
+    const char* values[LENGTH(fields)];
+    for (size_t i = 0; i < LENGTH(fields); i++) {
+      values[i] = meta_get(&meta, fields[i]);
+      if (values[i] == NULL || values[i][0] == '\0') {
+        values[i] = "-";
+      }
+    }
+    printf("%-16s  %-24s  %-16s  %-36s  %-10s  %-20s  %s\n", values[0], values[1], values[2], values[3],
+        values[4], values[5], values[6]);
+  }
+  closedir(dir);
+
+  return 0;
+}
+
+static int command_show(const char* store, const char* prefix) {
+  char run[4096], path[8192];
+  if (find_run(store, prefix, run, sizeof(run)) == false) {
+    return -1;
+  }
+
+  meta_t meta;
+  snprintf(path, sizeof(path), "%s/" META_FILE, run);
+  if (meta_read(&meta, path) == false) {
+    fprintf(stderr, "Error: Could not read %s\n", path);
+    return -1;
+  }
+
+  for (size_t i = 0; i < meta.n; i++) {
+    printf("%-16s %s\n", meta.keys[i], meta.values[i]);
+  }
+  printf("%-16s %s\n", "path", run);
+
+  return 0;
+}
+
+/* Column means of a CSV file with a header line; non-numeric columns are NAN */
+typedef struct csv_summary_s {
+  char header[4096];
+  char names[MAX_COLUMNS][64];
+  double sums[MAX_COLUMNS];
+  size_t counts[MAX_COLUMNS];
+  size_t columns;
+  size_t rows;
+} csv_summary_t;
+
+static bool csv_summarize(const char* path, csv_summary_t* s) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+
+  memset(s, 0, sizeof(*s));
+  if (fgets(s->header, sizeof(s->header), f) == NULL) {
+    fclose(f);
+    return false;
+  }
+  s->header[strcspn(s->header, "\r\n")] = '\0';
+
+  char header[4096];
+  snprintf(header, sizeof(header), "%s", s->header);
+  char* saveptr = NULL;
+  for (char* name = strtok_r(header, ",", &saveptr); name != NULL && s->columns < MAX_COLUMNS;
+      name = strtok_r(NULL, ",", &saveptr)) {
+    snprintf(s->names[s->columns++], sizeof(s->names[0]), "%s", name);
+  }
+
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    size_t column = 0;
+    char* p = line;
+    while (column < s->columns) {
+      char* end;
+      double value = strtod(p, &end);
+      if (end != p && (*end == ',' || *end == '\n' || *end == '\r' || *end == '\0')) {
+        s->sums[column] += value;
+        s->counts[column]++;
+      }
+      p = strchr(p, ',');
+      if (p == NULL) {
+        break;
+      }
+      p++;
+      column++;
+    }
+    s->rows++;
+  }
+  fclose(f);
+
+  return true;
+}
+
+static int command_compare(const char* store, const char* prefix_a, const char* prefix_b) {
+  char run_a[4096], run_b[4096], path[8192];
+  if (find_run(store, prefix_a, run_a, sizeof(run_a)) == false || find_run(store, prefix_b, run_b, sizeof(run_b)) == false) {
+    return -1;
+  }
+
+  meta_t a, b;
+  snprintf(path, sizeof(path), "%s/" META_FILE, run_a);
+  bool ok = meta_read(&a, path);
+  snprintf(path, sizeof(path), "%s/" META_FILE, run_b);
+  ok &= meta_read(&b, path);
+  if (ok == false) {
+    fprintf(stderr, "Error: Could not read the metadata\n");
+    return -1;
+  }
+
+  /* Metadata that differs */
+  printf("%-16s %-40s %s\n", "key", meta_get(&a, "id"), meta_get(&b, "id"));
+  for (size_t i = 0; i < a.n; i++) {
+    const char* other = meta_get(&b, a.keys[i]);
+    if (strcmp(a.keys[i], "id") != 0 && (other == NULL || strcmp(other, a.values[i]) != 0)) {
+      printf("%-16s %-40s %s\n", a.keys[i], a.values[i], other ? other : "-");
+    }
+  }
+  for (size_t i = 0; i < b.n; i++) {
+    if (meta_get(&a, b.keys[i]) == NULL) {
+      printf("%-16s %-40s %s\n", b.keys[i], "-", b.values[i]);
+    }
+  }
+
+  /* Column means of every file both runs have */
+  char files[1024];
+  snprintf(files, sizeof(files), "%s", meta_get(&a, "files") ? meta_get(&a, "files") : "");
+  const char* files_b = meta_get(&b, "files") ? meta_get(&b, "files") : "";
+
+  char* saveptr = NULL;
+  for (char* name = strtok_r(files, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+    size_t length = strlen(name);
+    const char* found = strstr(files_b, name);
+    if (found == NULL || (found != files_b && found[-1] != ',') || (found[length] != ',' && found[length] != '\0')) {
+      continue;
+    }
+
+    csv_summary_t sa, sb;
+    char path_a[8192], path_b[8192];
+    snprintf(path_a, sizeof(path_a), "%s/%s", run_a, name);
+    snprintf(path_b, sizeof(path_b), "%s/%s", run_b, name);
+    if (csv_summarize(path_a, &sa) == false || csv_summarize(path_b, &sb) == false) {
+      continue;
+    }
+
+    printf("\n%s (%zu vs %zu rows)\n", name, sa.rows, sb.rows);
+    if (strcmp(sa.header, sb.header) != 0) {
+      printf("  " COLOR_YELLOW "different columns, not compared" COLOR_RESET "\n");
+      continue;
+    }
+
+    printf("  %-24s %14s %14s %10s\n", "column (mean)", "a", "b", "change");
+    for (size_t i = 0; i < sa.columns; i++) {
+      if (sa.counts[i] == 0 || sb.counts[i] == 0) {
+        continue;
+      }
+      double mean_a = sa.sums[i] / sa.counts[i];
+      double mean_b = sb.sums[i] / sb.counts[i];
+      double change = (mean_a != 0) ? (mean_b - mean_a) / fabs(mean_a) * 100 : NAN;
+      printf("  %-24s %14.3f %14.3f %9.2f%%\n", sa.names[i], mean_a, mean_b, change);
+    }
+  }
+
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void
+print_help(char* argv[]) {
+  fprintf(stdout, "Usage: %s <command> [OPTIONS] [ARGUMENTS]\n", argv[0]);
+  fprintf(stdout, "Commands:\n");
+  fprintf(stdout, "\tadd <file>...\t\t Store result files with the metadata of this machine; prints the run id\n");
+  fprintf(stdout, "\tlist\t\t\t List the stored runs\n");
+  fprintf(stdout, "\tshow <id>\t\t Print the metadata of a run\n");
+  fprintf(stdout, "\tcompare <id> <id>\t Print the metadata that differs and compare common CSV files\n");
+  fprintf(stdout, "Options:\n");
+  fprintf(stdout, "\t-s, -store <dir>\t Store directory (default: $" STORE_ENV " or " STORE_DEFAULT ")\n");
+  fprintf(stdout, "\t-t, -tool <name>\t Tool that produced the files (add)\n");
+  fprintf(stdout, "\t-p, -params <text>\t Parameters of the run (add)\n");
+  fprintf(stdout, "\t-m, -meta <key=value>\t Set or override a metadata field (add)\n");
+  fprintf(stdout, "\t-q, -query <key=value>\t Only runs whose field contains value (list)\n");
+  fprintf(stdout, "\t-h, -help\t\t Help page\n");
+}
+
+static bool parse_pair(meta_t* meta, const char* pair) {
+  char buffer[512];
+  snprintf(buffer, sizeof(buffer), "%s", pair);
+
+  char* value = strchr(buffer, '=');
+  if (value == NULL || meta->n == MAX_META) {
+    fprintf(stderr, "Error: Expected key=value, got '%s'\n", pair);
+    return false;
+  }
+  *value++ = '\0';
+  meta_set(meta, buffer, value);
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  /* Parse arguments */
+  const char* store = getenv(STORE_ENV) ? getenv(STORE_ENV) : STORE_DEFAULT;
+  meta_t overrides = { .n = 0 };
+  meta_t queries = { .n = 0 };
+
+  static const char* short_options = "s:t:p:m:q:h";
+  static struct option long_options[] = {
+    {"store",           required_argument, NULL, 's'},
+    {"tool",            required_argument, NULL, 't'},
+    {"params",          required_argument, NULL, 'p'},
+    {"meta",            required_argument, NULL, 'm'},
+    {"query",           required_argument, NULL, 'q'},
+    {"help",            no_argument,       NULL, 'h'},
+    { NULL,             0, NULL, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+    switch (c) {
+      case 's':
+        store = optarg;
+        break;
+      case 't':
+        meta_set(&overrides, "tool", optarg);
+        break;
+      case 'p':
+        meta_set(&overrides, "params", optarg);
+        break;
+      case 'm':
+        if (parse_pair(&overrides, optarg) == false) {
+          return -1;
+        }
+        break;
+      case 'q':
+        if (queries.n == MAX_QUERIES || parse_pair(&queries, optarg) == false) {
+          return -1;
+        }
+        break;
+      case 'h':
+        print_help(argv);
+        return 0;
+      case ':':
+        fprintf(stderr, "Error: option `-%c' requires an argument\n", optopt);
+        break;
+      case '?':
+      default:
+        fprintf(stderr, "Error: Invalid option '-%c'\n", optopt);
+        return -1;
+    }
+  }
+
+  if (optind >= argc) {
+    print_help(argv);
+    return -1;
+  }
+
+  const char* command = argv[optind];
+  char** arguments = argv + optind + 1;
+  size_t number_of_arguments = argc - optind - 1;
+
+  if (strcmp(command, "add") == 0) {
+    return command_add(store, &overrides, arguments, number_of_arguments);
+  } else if (strcmp(command, "list") == 0) {
+    return command_list(store, &queries);
+  } else if (strcmp(command, "show") == 0 && number_of_arguments == 1) {
+    return command_show(store, arguments[0]);
+  } else if (strcmp(command, "compare") == 0 && number_of_arguments == 2) {
+    return command_compare(store, arguments[0], arguments[1]);
+  }
+
+  fprintf(stderr, "Error: Invalid command '%s'\n", command);
+  print_help(argv);
+
+  return -1;
+}
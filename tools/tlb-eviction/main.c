@@ -0,0 +1,404 @@
+/* See LICENSE file for license and copyright information */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
+
+#include "libtlb.h"
+#include "cacheutils.h"
+#include "performance-counter.h"
+#include "ptedit_header.h"
+
+#define COLOR_RED     "\x1b[31m"
+#define COLOR_GREEN   "\x1b[32m"
+#define COLOR_YELLOW  "\x1b[33m"
+#define COLOR_RESET   "\x1b[0m"
+
+#define _STR(x) #x
+#define STR(x) _STR(x)
+
+#define CORE1 3
+#define TRIES 1000
+#define TARGETS 16
+#define MAX_TARGETS 256
+
+/* Targets are picked from this many pages; the calibration sweep aliases a
+ * single physical page and is large enough to overflow any L2 dTLB */
+#define TARGET_PAGES 1024
+#define CALIBRATION_PAGES (16 * 1024)
+
+#define EVICTION_RATE_RELIABLE 0.99
+#define WALK_EVENT "ls_tablewalker.dside"
+
+typedef enum strategy_e {
+  STRATEGY_FULL = 0,
+  STRATEGY_TARGETED,
+  STRATEGY_RANDOM,
+  STRATEGY_PTEDIT,
+  STRATEGY_MAX
+} strategy_t;
+
+static const char* strategy_names[] = {
+  [STRATEGY_FULL]     = "full",
+  [STRATEGY_TARGETED] = "targeted",
+  [STRATEGY_RANDOM]   = "randomized",
+  [STRATEGY_PTEDIT]   = "ptedit_invalidate_tlb",
+};
+
+typedef struct result_s {
+  bool available;
+  size_t cost;            /* median cycles of the strategy */
+  float timing_rate;      /* fraction of tries whose reload was above the threshold */
+  float counter_rate;     /* page walks per target reload, -1 without counter */
+} result_t;
+
+static char* targets_buffer = NULL;
+static char* calibration = NULL;
+static char* targets[MAX_TARGETS];
+static size_t targets_offsets[MAX_TARGETS];
+static size_t number_of_targets = TARGETS;
+static size_t threshold;
+
+static void pin_thread_to_core(pthread_t p, int core) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    pthread_setaffinity_np(p, sizeof(cpu_set_t), &cpuset);
+}
+
+static bool setup(void) {
+  targets_buffer = mmap(NULL, TARGET_PAGES * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (targets_buffer == MAP_FAILED) {
+    return false;
+  }
+
+  calibration = _tlb_alloc_buffer(CALIBRATION_PAGES * 4096);
+  if (calibration == NULL) {
+    return false;
+  }
+
+  /* Distinct random target pages */
+  uint8_t used[TARGET_PAGES] = {0};
+  for (size_t i = 0; i < number_of_targets; i++) {
+    size_t page;
+    do {
+      page = rand() % TARGET_PAGES;
+    } while (used[page]);
+    used[page] = 1;
+
+    targets[i] = targets_buffer + page * 4096;
+    targets_offsets[i] = (size_t) targets[i];
+  }
+
+  return true;
+}
+
+static inline __attribute__((always_inline)) void touch_targets(void) {
+  for (size_t i = 0; i < number_of_targets; i++) {
+    maccess(targets[i]);
+    maccess(targets[i]);
+  }
+  asm volatile("lfence");
+}
+
+static inline __attribute__((always_inline)) size_t reload(void* address) {
+  size_t begin = rdtsc();
+  maccess(address);
+  size_t end = rdtsc();
+
+  return end - begin;
+}
+
+static inline __attribute__((always_inline)) void evict(strategy_t strategy) {
+  switch (strategy) {
+    case STRATEGY_FULL:
+      tlb_eviction_mode = TLB_EVICTION_SEQUENTIAL;
+      tlb_flush();
+      break;
+    case STRATEGY_TARGETED:
+      tlb_eviction_mode = TLB_EVICTION_SEQUENTIAL;
+      tlb_evict_addresses(targets_offsets, number_of_targets);
+      break;
+    case STRATEGY_RANDOM:
+      tlb_eviction_mode = TLB_EVICTION_RANDOM;
+      tlb_flush();
+      break;
+    case STRATEGY_PTEDIT:
+      for (size_t i = 0; i < number_of_targets; i++) {
+        ptedit_invalidate_tlb(targets[i]);
+      }
+      break;
+    default:
+      break;
+  }
+  asm volatile("lfence");
+}
+
+static int compare_size(const void* a, const void* b) {
+  size_t va = *(const size_t*) a;
+  size_t vb = *(const size_t*) b;
+
+  return (va > vb) - (va < vb);
+}
+
+static size_t median(size_t* values, size_t n) {
+  qsort(values, n, sizeof(size_t), compare_size);
+
+  return values[n / 2];
+}
+
+/* Reload latency of a target after it was touched (hit) or after a sweep over
+ * the calibration region (page walk) */
+static void calibrate(size_t tries, size_t* hit, size_t* walk) {
+  size_t* values = calloc(tries, sizeof(size_t));
+
+  for (size_t i = 0; i < tries; i++) {
+    touch_targets();
+    values[i] = reload(targets[i % number_of_targets]);
+  }
+  *hit = median(values, tries);
+
+  for (size_t i = 0; i < tries; i++) {
+    touch_targets();
+    for (size_t p = 0; p < CALIBRATION_PAGES; p++) {
+      maccess(calibration + p * 4096);
+    }
+    asm volatile("lfence");
+    values[i] = reload(targets[i % number_of_targets]);
+  }
+  *walk = median(values, tries);
+
+  free(values);
+}
+
+static void run_strategy(strategy_t strategy, size_t tries, performance_counter_group_t* group, result_t* result) {
+  size_t* cost = calloc(tries, sizeof(size_t));
+  size_t evicted = 0;
+
+  /* Cost and timed reloads */
+  for (size_t i = 0; i < tries; i++) {
+    touch_targets();
+
+    size_t begin = rdtsc();
+    evict(strategy);
+    cost[i] = rdtsc() - begin;
+
+    /* A single timed reload per try: once the first walk filled the
+     * paging-structure caches, walks of the other targets are too fast
+     * to tell apart from hits */
+    if (reload(targets[i % number_of_targets]) > threshold) {
+      evicted++;
+    }
+  }
+
+  result->cost = median(cost, tries);
+  result->timing_rate = (float) evicted / tries;
+  result->counter_rate = -1;
+
+  /* Page walks of the reloads: walks of eviction + reload minus walks of the
+   * eviction alone. The counter is read before the targets are touched so
+   * that the read syscall cannot evict them. */
+  if (group != NULL && group->n > 0) {
+    size_t* with_reload = cost;
+    size_t* without_reload = calloc(tries, sizeof(size_t));
+
+    for (size_t i = 0; i < tries; i++) {
+      performance_counter_group_values_t begin, end;
+
+      performance_counter_group_read(group, &begin);
+      touch_targets();
+      evict(strategy);
+      for (size_t t = 0; t < number_of_targets; t++) {
+        maccess(targets[t]);
+      }
+      performance_counter_group_read(group, &end);
+      with_reload[i] = end.values[0] - begin.values[0];
+
+      performance_counter_group_read(group, &begin);
+      touch_targets();
+      evict(strategy);
+      performance_counter_group_read(group, &end);
+      without_reload[i] = end.values[0] - begin.values[0];
+    }
+
+    float walks = (float) median(with_reload, tries) - (float) median(without_reload, tries);
+    result->counter_rate = walks / number_of_targets;
+    if (result->counter_rate < 0) {
+      result->counter_rate = 0;
+    } else if (result->counter_rate > 1) {
+      result->counter_rate = 1;
+    }
+
+    free(without_reload);
+  }
+
+  result->available = true;
+  free(cost);
+}
+
+static void
+print_help(char* argv[]) {
+  fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
+  fprintf(stdout, "\t-c, -core <value>\t Bind to cpu (default: " STR(CORE1) ")\n");
+  fprintf(stdout, "\t-n, -targets <value>\t Number of target pages (default: " STR(TARGETS) ")\n");
+  fprintf(stdout, "\t-t, -tries <value>\t Number of tries per strategy (default: " STR(TRIES) ")\n");
+  fprintf(stdout, "\t-s, -seed <value>\t Seed of the target selection and randomized eviction\n");
+  fprintf(stdout, "\t-h, -help\t\t Help page\n");
+}
+
+int main(int argc, char* argv[])
+{
+  /* Parse arguments */
+  size_t cpu = CORE1;
+  size_t tries = TRIES;
+  uint64_t seed = time(NULL) ^ getpid();
+
+  static const char* short_options = "c:n:t:s:h";
+  static struct option long_options[] = {
+    {"cpu",             required_argument, NULL, 'c'},
+    {"targets",         required_argument, NULL, 'n'},
+    {"tries",           required_argument, NULL, 't'},
+    {"seed",            required_argument, NULL, 's'},
+    {"help",            no_argument,       NULL, 'h'},
+    { NULL,             0, NULL, 0}
+  };
+
+  size_t number_of_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  int c;
+  while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+    switch (c) {
+      case 'c':
+        cpu = atoi(optarg);
+        if (cpu >= number_of_cpus) {
+          fprintf(stderr, "Error: CPU %zu is not available.\n", cpu);
+          return -1;
+        }
+        break;
+      case 'n':
+        number_of_targets = atoi(optarg);
+        if (number_of_targets == 0 || number_of_targets > MAX_TARGETS) {
+          fprintf(stderr, "Error: Number of targets must be between 1 and %d.\n", MAX_TARGETS);
+          return -1;
+        }
+        break;
+      case 't':
+        tries = atoi(optarg);
+        if (tries == 0) {
+          fprintf(stderr, "Error: Number of tries must be positive.\n");
+          return -1;
+        }
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'h':
+        print_help(argv);
+        return 0;
+      case ':':
+        fprintf(stderr, "Error: option `-%c' requires an argument\n", optopt);
+        break;
+      case '?':
+      default:
+        fprintf(stderr, "Error: Invalid option '-%c'\n", optopt);
+        return -1;
+    }
+  }
+
+  pin_thread_to_core(pthread_self(), cpu);
+
+  srand(seed);
+  tlb_init();
+  tlb_randomize(seed);
+
+  if (setup() == false) {
+    fprintf(stderr, "Error: Could not setup target pages\n");
+    return -1;
+  }
+
+  /* Calibrate */
+  size_t t_hit, t_walk;
+  calibrate(tries, &t_hit, &t_walk);
+  threshold = (t_hit + t_walk) / 2;
+
+  fprintf(stderr, "Seed: 0x%lx, Targets: %zu, Hit: %zu, Page walk: %zu, Threshold: %zu\n",
+      seed, number_of_targets, t_hit, t_walk, threshold);
+  if (t_walk <= t_hit + 1) {
+    fprintf(stderr, COLOR_RED "Error: Page walks are not distinguishable\n" COLOR_RESET);
+    return -1;
+  }
+
+  /* Page-walk counter, if the PMU exposes it */
+  performance_counter_group_t group = performance_counter_group_init(getpid());
+  if (performance_counter_group_add_event(&group, WALK_EVENT) == true) {
+    performance_counter_group_reset(&group);
+    performance_counter_group_enable(&group);
+  } else {
+    fprintf(stderr, COLOR_YELLOW "Warning: No page-walk counter, using reload timing only\n" COLOR_RESET);
+  }
+
+  bool with_ptedit = (ptedit_init() == 0);
+  if (with_ptedit == false) {
+    fprintf(stderr, COLOR_YELLOW "Warning: PTEditor is not available, skipping ptedit_invalidate_tlb\n" COLOR_RESET);
+  }
+
+  /* Benchmark */
+  result_t results[STRATEGY_MAX] = {0};
+  for (strategy_t s = 0; s < STRATEGY_MAX; s++) {
+    if (s == STRATEGY_PTEDIT && with_ptedit == false) {
+      continue;
+    }
+    run_strategy(s, tries, &group, &results[s]);
+  }
+
+  /* Report; the counter decides if available, timing otherwise */
+  int best = -1;
+  fprintf(stdout, "%24s %12s %12s %12s\n", "strategy", "cycles", "timing", "walks");
+  for (strategy_t s = 0; s < STRATEGY_MAX; s++) {
+    result_t* r = &results[s];
+    if (r->available == false) {
+      fprintf(stdout, "%24s %12s %12s %12s\n", strategy_names[s], "-", "-", "-");
+      continue;
+    }
+
+    float rate = (r->counter_rate >= 0) ? r->counter_rate : r->timing_rate;
+    bool reliable = (rate >= EVICTION_RATE_RELIABLE);
+    if (reliable && (best == -1 || r->cost < results[best].cost)) {
+      best = s;
+    }
+
+    char counter[16] = "-";
+    if (r->counter_rate >= 0) {
+      snprintf(counter, sizeof(counter), "%.2f%%", r->counter_rate * 100);
+    }
+
+    fprintf(stdout, "%s%24s %12zu %11.2f%% %12s" COLOR_RESET "\n", reliable ? COLOR_GREEN : COLOR_RED,
+        strategy_names[s], r->cost, r->timing_rate * 100, counter);
+  }
+
+  if (best == -1) {
+    fprintf(stdout, COLOR_RED "No strategy reaches %.0f%% eviction\n" COLOR_RESET, EVICTION_RATE_RELIABLE * 100);
+  } else {
+    fprintf(stdout, COLOR_GREEN "Cheapest strategy with %.0f%% eviction: %s\n" COLOR_RESET,
+        EVICTION_RATE_RELIABLE * 100, strategy_names[best]);
+  }
+
+  /* Cleanup */
+  if (group.n > 0) {
+    performance_counter_group_disable(&group);
+  }
+  if (with_ptedit == true) {
+    ptedit_cleanup();
+  }
+
+  return (best == -1) ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/* See LICENSE file for license and copyright information */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <cpuid.h>
+
+#include "cacheutils.h"
+
+#define COLOR_RED     "\x1b[31m"
+#define COLOR_GREEN   "\x1b[32m"
+#define COLOR_YELLOW  "\x1b[33m"
+#define COLOR_RESET   "\x1b[0m"
+
+#define _STR(x) #x
+#define STR(x) _STR(x)
+
+#define CORE1 3
+#define TRIES 64
+
+/* Virtual pages of the probe region; all of them alias a few physical pages
+ * so that the data cache footprint stays small */
+#define REGION_PAGES (64 * 1024)
+#define ALIAS_PAGES 16
+
+#define MAX_STRIDE 1024
+#define EVICTION_RATE_DETECT 0.5
+#define EVICTION_RATE_RELIABLE 0.99
+
+/* Line offsets used for the target and the eviction pages */
+#define TARGET_OFFSET 0
+#define EVICTION_OFFSET 64
+
+static char* region = NULL;
+static size_t threshold[2];
+
+typedef struct level_s {
+  const char* name;
+  size_t entries;
+  size_t sets;
+  size_t ways;
+  size_t eviction_ways;
+  bool indexed;
+} level_t;
+
+static void pin_thread_to_core(pthread_t p, int core) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    pthread_setaffinity_np(p, sizeof(cpu_set_t), &cpuset);
+}
+
+static bool setup_region(void) {
+  int fd = memfd_create("tlb-geometry", 0);
+  if (fd < 0 || ftruncate(fd, ALIAS_PAGES * 4096) != 0) {
+    return false;
+  }
+
+  region = mmap(NULL, REGION_PAGES * 4096ull, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED) {
+    return false;
+  }
+
+  for (size_t i = 0; i < REGION_PAGES; i += ALIAS_PAGES) {
+    void* m = mmap(region + i * 4096, ALIAS_PAGES * 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (m == MAP_FAILED) {
+      return false;
+    }
+  }
+  close(fd);
+
+  /* Populate page tables */
+  for (size_t i = 0; i < REGION_PAGES; i++) {
+    region[i * 4096 + EVICTION_OFFSET] = 1;
+  }
+
+  return true;
+}
+
+static inline __attribute__((always_inline)) void sweep(size_t stride, size_t n) {
+  for (size_t i = 1; i <= n; i++) {
+    maccess(region + i * stride * 4096 + EVICTION_OFFSET);
+  }
+}
+
+static size_t probe(size_t stride, size_t n) {
+  maccess(region + TARGET_OFFSET);
+  maccess(region + TARGET_OFFSET);
+  sweep(stride, n);
+  asm volatile("lfence");
+
+  size_t begin = rdtsc();
+  maccess(region + TARGET_OFFSET);
+  size_t end = rdtsc();
+
+  return end - begin;
+}
+
+static int compare_size(const void* a, const void* b) {
+  size_t va = *(const size_t*) a;
+  size_t vb = *(const size_t*) b;
+
+  return (va > vb) - (va < vb);
+}
+
+static size_t median_probe(size_t stride, size_t n) {
+  size_t values[TRIES];
+  for (size_t i = 0; i < TRIES; i++) {
+    values[i] = probe(stride, n);
+  }
+  qsort(values, TRIES, sizeof(size_t), compare_size);
+
+  return values[TRIES / 2];
+}
+
+/* Fraction of tries in which the target was evicted from the given level */
+static float eviction_rate(int level, size_t stride, size_t n) {
+  size_t evicted = 0;
+  for (size_t i = 0; i < TRIES; i++) {
+    if (probe(stride, n) > threshold[level]) {
+      evicted++;
+    }
+  }
+
+  return (float) evicted / TRIES;
+}
+
+/* Smallest number of eviction pages that reaches the given eviction rate */
+static size_t minimum_eviction_set(int level, size_t stride, float rate) {
+  size_t max_n = (REGION_PAGES - 1) / stride;
+  size_t hi = 1;
+
+  while (hi <= max_n && eviction_rate(level, stride, hi) < rate) {
+    hi *= 2;
+  }
+  if (hi > max_n) {
+    if (eviction_rate(level, stride, max_n) < rate) {
+      return 0;
+    }
+    hi = max_n;
+  }
+
+  size_t lo = hi / 2 + 1;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (eviction_rate(level, stride, mid) >= rate) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  return hi;
+}
+
+/* For a TLB indexed by the low VPN bits, the minimum eviction set halves
+ * with every doubling of the stride until the stride reaches the number of
+ * sets; from there on, it stays at the associativity. */
+static bool discover_level(int level, level_t* result, bool verbose) {
+  size_t minimum[32] = {0};
+  size_t n_strides = 0;
+
+  for (size_t stride = 1; stride <= MAX_STRIDE; stride *= 2) {
+    size_t m = minimum_eviction_set(level, stride, EVICTION_RATE_DETECT);
+    if (verbose) {
+      fprintf(stderr, "  %s stride %4zu: %6zu pages\n", result->name, stride, m);
+    }
+    if (m == 0) {
+      break;
+    }
+    minimum[n_strides++] = m;
+  }
+
+  if (n_strides == 0) {
+    return false;
+  }
+
+  result->entries = minimum[0];
+  result->sets = 1;
+  for (size_t i = 0; i + 1 < n_strides; i++) {
+    if (minimum[i + 1] * 4 > minimum[i] * 3) {
+      break;
+    }
+    result->sets *= 2;
+  }
+  result->ways = minimum[__builtin_ctzl(result->sets)];
+
+  /* Check the model: ways * sets / min(stride, sets) for every stride */
+  result->indexed = true;
+  for (size_t i = 0; i < n_strides; i++) {
+    size_t stride = 1ull << i;
+    float expected = (float) result->ways * result->sets / (stride < result->sets ? stride : result->sets);
+    if (minimum[i] < expected * 0.75 || minimum[i] > expected * 1.25) {
+      result->indexed = false;
+    }
+  }
+
+  /* Fall back to a fully associative sweep if the index function is unknown */
+  if (result->indexed == false) {
+    result->sets = 1;
+    result->ways = result->entries;
+  }
+
+  result->eviction_ways = minimum_eviction_set(level, result->sets, EVICTION_RATE_RELIABLE);
+  if (result->eviction_ways == 0) {
+    result->eviction_ways = result->ways;
+  }
+
+  return true;
+}
+
+static void default_profile_path(char* path, size_t length) {
+  unsigned int a = 0, b, c, d;
+  __get_cpuid(1, &a, &b, &c, &d);
+
+  unsigned int family = (a >> 8) & 0xf;
+  unsigned int model = (a >> 4) & 0xf;
+  if (family == 0xf) {
+    family += (a >> 20) & 0xff;
+    model |= ((a >> 16) & 0xf) << 4;
+  }
+
+  snprintf(path, length, "tlb-%02x-%02x.profile", family, model);
+}
+
+static void
+print_help(char* argv[]) {
+  fprintf(stdout, "Usage: %s [OPTIONS]\n", argv[0]);
+  fprintf(stdout, "\t-c, -core <value>\t Bind to cpu (default: " STR(CORE1) ")\n");
+  fprintf(stdout, "\t-o, -output <file>\t Profile to write (default: tlb-<family>-<model>.profile)\n");
+  fprintf(stdout, "\t-v, -verbose\t\t Print the eviction curves\n");
+  fprintf(stdout, "\t-h, -help\t\t Help page\n");
+}
+
+int main(int argc, char* argv[])
+{
+  /* Parse arguments */
+  size_t cpu = CORE1;
+  bool verbose = false;
+  char path[256];
+  default_profile_path(path, sizeof(path));
+
+  static const char* short_options = "c:o:vh";
+  static struct option long_options[] = {
+    {"cpu",             required_argument, NULL, 'c'},
+    {"output",          required_argument, NULL, 'o'},
+    {"verbose",         no_argument,       NULL, 'v'},
+    {"help",            no_argument,       NULL, 'h'},
+    { NULL,             0, NULL, 0}
+  };
+
+  size_t number_of_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  int c;
+  while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+    switch (c) {
+      case 'c':
+        cpu = atoi(optarg);
+        if (cpu >= number_of_cpus) {
+          fprintf(stderr, "Error: CPU %zu is not available.\n", cpu);
+          return -1;
+        }
+        break;
+      case 'o':
+        snprintf(path, sizeof(path), "%s", optarg);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      case 'h':
+        print_help(argv);
+        return 0;
+      case ':':
+        fprintf(stderr, "Error: option `-%c' requires an argument\n", optopt);
+        break;
+      case '?':
+      default:
+        fprintf(stderr, "Error: Invalid option '-%c'\n", optopt);
+        return -1;
+    }
+  }
+
+  pin_thread_to_core(pthread_self(), cpu);
+
+  if (setup_region() == false) {
+    fprintf(stderr, "Error: Could not setup probe region\n");
+    return -1;
+  }
+
+  /* Calibrate: TLB hit, L1 miss / L2 hit, L2 miss (page walk) */
+  size_t t_hit = median_probe(1, 0);
+  size_t t_l2 = median_probe(1, 128);
+  size_t t_walk = median_probe(1, REGION_PAGES / 4);
+  threshold[0] = (t_hit + t_l2) / 2;
+  threshold[1] = (t_l2 + t_walk) / 2;
+
+  fprintf(stderr, "Hit: %zu, L2 hit: %zu, Page walk: %zu\n", t_hit, t_l2, t_walk);
+  if (t_l2 <= t_hit + 1) {
+    fprintf(stderr, COLOR_YELLOW "Warning: L1 and L2 TLB hits are not distinguishable\n" COLOR_RESET);
+  }
+  if (t_walk <= t_l2 + 1) {
+    fprintf(stderr, COLOR_RED "Error: Page walks are not distinguishable\n" COLOR_RESET);
+    return -1;
+  }
+
+  level_t levels[2] = {
+    { .name = "L1 dTLB" },
+    { .name = "L2 dTLB" },
+  };
+
+  for (int level = 0; level < 2; level++) {
+    if (discover_level(level, &levels[level], verbose) == false) {
+      fprintf(stderr, COLOR_RED "Error: Could not evict %s\n" COLOR_RESET, levels[level].name);
+      return -1;
+    }
+
+    level_t* l = &levels[level];
+    fprintf(stderr, COLOR_GREEN "%s: %zu entries, %zu sets, %zu ways (%s), %zu pages per set for %.0f%% eviction\n" COLOR_RESET,
+        l->name, l->entries, l->sets, l->ways, l->indexed ? "VPN mod sets" : "unknown index, treated as fully associative",
+        l->eviction_ways, EVICTION_RATE_RELIABLE * 100);
+  }
+
+  /* Write profile */
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", path);
+    return -1;
+  }
+
+  fprintf(f, "# tlb-geometry profile (hit: %zu, l2 hit: %zu, walk: %zu)\n", t_hit, t_l2, t_walk);
+  fprintf(f, "l1_sets=%zu\n", levels[0].sets);
+  fprintf(f, "l1_ways=%zu\n", levels[0].eviction_ways);
+  fprintf(f, "l1_stride=%zu\n", levels[0].sets);
+  fprintf(f, "l2_sets=%zu\n", levels[1].sets);
+  fprintf(f, "l2_ways=%zu\n", levels[1].eviction_ways);
+  fprintf(f, "l2_stride=%zu\n", levels[1].sets);
+  fclose(f);
+
+  fprintf(stderr, "Profile written to %s\n", path);
+
+  return 0;
+}